@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui widgets
+QT       += core gui widgets concurrent
 CONFIG   += c++11
 lessThan(QT_MAJOR_VERSION, 5): error("requires Qt 5")
 
@@ -30,10 +30,29 @@
 #include "qjsonmodel.h"
 #include "serialization.h"
 #include <QFile>
+#include <QHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QLocale>
+#include <QSet>
 #include <QDebug>
 #include <QFont>
 #include <QValidator>
+#include <QtAlgorithms>
+#include <QtConcurrent>
+#include <QThreadPool>
 #include <string>
+#include <new>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define QJSONMODEL_SSE2
+#  include <emmintrin.h>
+#endif
 
 
 uint32_t QDateToBcd(const QDate &date) {
@@ -68,6 +87,27 @@ inline bool contains(const QStringList& list, const QString &value) {
     return false;
 }
 
+//!< Source of a pending container without the members an expanded item would skip
+static QJsonValue withoutExceptions(const QJsonValue &value, const QStringList &exceptions)
+{
+    if (value.isObject()) {
+        QJsonObject obj;
+        const QJsonObject source = value.toObject();
+        for (auto it = source.constBegin(); it != source.constEnd(); ++it)
+            if (!contains(exceptions, it.key()))
+                obj.insert(it.key(), withoutExceptions(it.value(), exceptions));
+        return obj;
+    }
+    if (value.isArray()) {
+        QJsonArray arr;
+        for (const QJsonValue &v : value.toArray())
+            arr.append(withoutExceptions(v, exceptions));
+        return arr;
+    }
+
+    return value;
+}
+
 QJsonTreeItem::QJsonTreeItem(QJsonTreeItem *parent)
 {
     mParent = parent;
@@ -75,19 +115,77 @@ QJsonTreeItem::QJsonTreeItem(QJsonTreeItem *parent)
 
 QJsonTreeItem::~QJsonTreeItem()
 {
-    qDeleteAll(mChilds);
+    // Arena allocated children are released by their arena
+    if (!mArenaAllocated)
+        qDeleteAll(mChilds);
+    delete mRegister;
+}
+
+QJsonTreeItem *QJsonTreeItem::create(QJsonTreeItem *parent, QJsonTreeItemArena *arena)
+{
+    return arena ? arena->create(parent) : new QJsonTreeItem(parent);
 }
 
 void QJsonTreeItem::appendChild(QJsonTreeItem *item)
 {
+    item->mParent = this;
+    item->mRow = mChilds.count();
     mChilds.append(item);
 }
 
+void QJsonTreeItem::insertChild(int row, QJsonTreeItem *item)
+{
+    item->mParent = this;
+    mChilds.insert(row, item);
+    updateRows(row, mChilds.count() - 1);
+}
+
+QJsonTreeItem *QJsonTreeItem::takeChild(int row)
+{
+    QJsonTreeItem *item = mChilds.takeAt(row);
+    updateRows(row, mChilds.count() - 1);
+    item->mParent = nullptr;
+    item->mRow = 0;
+
+    return item;
+}
+
+QList<QJsonTreeItem*> QJsonTreeItem::takeChildren(int row, int count)
+{
+    const QList<QJsonTreeItem*> items = mChilds.mid(row, count);
+    mChilds.erase(mChilds.begin() + row, mChilds.begin() + row + count);
+    updateRows(row, mChilds.count() - 1);
+    for (QJsonTreeItem *item : items) {
+        item->mParent = nullptr;
+        item->mRow = 0;
+    }
+
+    return items;
+}
+
+void QJsonTreeItem::moveChild(int from, int to)
+{
+    mChilds.move(from, to);
+    updateRows(qMin(from, to), qMax(from, to));
+}
+
+//!< Refreshes cached rows of the children in [first, last] after the list was modified
+void QJsonTreeItem::updateRows(int first, int last)
+{
+    for (int i = first; i <= last; ++i)
+        mChilds.at(i)->mRow = i;
+}
+
 QJsonTreeItem *QJsonTreeItem::child(int row)
 {
     return mChilds.value(row);
 }
 
+const QJsonTreeItem *QJsonTreeItem::child(int row) const
+{
+    return mChilds.value(row);
+}
+
 QJsonTreeItem *QJsonTreeItem::parent()
 {
     return mParent;
@@ -100,10 +198,7 @@ int QJsonTreeItem::childCount() const
 
 int QJsonTreeItem::row() const
 {
-    if (mParent)
-        return mParent->mChilds.indexOf(const_cast<QJsonTreeItem*>(this));
-
-    return 0;
+    return mParent ? mRow : 0;
 }
 
 void QJsonTreeItem::setKey(const QString &key)
@@ -114,23 +209,21 @@ void QJsonTreeItem::setKey(const QString &key)
 void QJsonTreeItem::setValue(const QVariant &value)
 {
     mValue = value;
+    mDisplayCached = false;
 }
 
 void QJsonTreeItem::setFieldType(const JsonFieldType &type) {
-    mFieldType = type;
-    mAttrMap.insert(tagNames[TYPE], type);
+    registerInfo().fieldType = type;
 }
 
 void QJsonTreeItem::setAddress(int addr)
 {
-    mAddress = addr;
-    mAttrMap.insert(tagNames[ADDR], addr);
+    registerInfo().address = addr;
 }
 
 void QJsonTreeItem::setSize(int size)
 {
-    mLength = size;
-    mAttrMap.insert(tagNames[SIZE], size);
+    registerInfo().size = size;
 }
 
 void QJsonTreeItem::setType(const QJsonValue::Type &type)
@@ -140,48 +233,101 @@ void QJsonTreeItem::setType(const QJsonValue::Type &type)
 
 void QJsonTreeItem::setDescription(const QString &desc)
 {
-    mDescription = desc;
-    mAttrMap.insert(tagNames[DESC], desc);
+    registerInfo().description = desc;
 }
 
 void QJsonTreeItem::setEditMode(const JsonEditMode &editMode)
 {
-    mEditMode = editMode;
+    registerInfo().editMode = editMode;
+}
+
+QJsonTreeItem::RegisterInfo &QJsonTreeItem::registerInfo()
+{
+    if (!mRegister)
+        mRegister = new RegisterInfo;
+
+    return *mRegister;
+}
+
+bool QJsonTreeItem::hasRegisterInfo() const
+{
+    return mRegister != nullptr;
 }
 
+//! Key of a member, elements of an array are named by their row so that edits do not renumber them
 QString QJsonTreeItem::key() const
 {
+    if (mParent && mParent->mType == QJsonValue::Array)
+        return QString::number(mRow);
+
     return mKey;
 }
 
 QVariant QJsonTreeItem::value() const
 {
-    return mValue;
+    return mPending ? QVariant() : mValue;
+}
+
+/**
+ * @brief QJsonTreeItem::displayValue
+ * Value formatted the way the default delegate would show it, cached until
+ * setValue() or a pending-state change replaces the value. Sorting uses the
+ * raw value(), see QJsonModel::data() for Qt::UserRole.
+ */
+QString QJsonTreeItem::displayValue() const
+{
+    if (mDisplayCached)
+        return mDisplay;
+
+    const QVariant value = this->value();
+    QLocale locale;
+    switch (value.userType()) {
+    case QMetaType::Float:
+    case QMetaType::Double:
+        mDisplay = locale.toString(value.toDouble());
+        break;
+    case QMetaType::Int:
+    case QMetaType::LongLong:
+        mDisplay = locale.toString(value.toLongLong());
+        break;
+    case QMetaType::UInt:
+    case QMetaType::ULongLong:
+        mDisplay = locale.toString(value.toULongLong());
+        break;
+    case QMetaType::QDate:
+        mDisplay = locale.toString(value.toDate(), QLocale::ShortFormat);
+        break;
+    default:
+        mDisplay = value.toString();
+    }
+    mDisplayCached = true;
+
+    return mDisplay;
 }
 
 QString QJsonTreeItem::description() const
 {
-    return mDescription;
+    return mRegister ? mRegister->description : QString();
 }
 
 QJsonTreeItem::JsonEditMode QJsonTreeItem::editMode() const
 {
-    return mEditMode;
+    return mRegister ? mRegister->editMode : RW;
 }
 
 QJsonTreeItem::JsonFieldType QJsonTreeItem::fieldType() const
 {
-    return mFieldType;
+    return mRegister ? mRegister->fieldType : STRING;
 }
 
 int QJsonTreeItem::address() const
 {
-    return mAddress;
+    return mRegister ? mRegister->address : 0;
 }
 
 int QJsonTreeItem::size() const
 {
-    return mLength;
+    return mRegister ? mRegister->size : 0;
 }
 
 QJsonValue::Type QJsonTreeItem::type() const
@@ -189,6 +335,11 @@ QJsonValue::Type QJsonTreeItem::type() const
     return mType;
 }
 
+bool QJsonTreeItem::isArenaAllocated() const
+{
+    return mArenaAllocated;
+}
+
 bool QJsonTreeItem::isLeaf() const
 {
     return mIsLeaf;
@@ -199,30 +350,144 @@ void QJsonTreeItem::setAsLeaf()
     mIsLeaf = true;
 }
 
-QJsonTreeItem* QJsonTreeItem::load(const QJsonValue& value, const QStringList &exceptions, QJsonTreeItem* parent)
+bool QJsonTreeItem::isDirty() const
+{
+    return mDirty;
+}
+
+void QJsonTreeItem::setDirty(bool dirty)
+{
+    mDirty = dirty;
+}
+
+bool QJsonTreeItem::isPending() const
+{
+    return mPending;
+}
+
+void QJsonTreeItem::setPending(const QJsonValue &source)
+{
+    // Stored as is, toVariant() would convert the whole subtree
+    mValue = QVariant::fromValue(source);
+    mPending = true;
+    mDisplayCached = false;
+}
+
+//! Raw JSON text of the container, parsed only when its children are created
+void QJsonTreeItem::setPending(const QByteArray &json)
+{
+    mValue = json;
+    mPending = true;
+    mDisplayCached = false;
+}
+
+//! Source of a pending container, text kept by loadLazy() is parsed on every call
+QJsonValue QJsonTreeItem::pendingValue() const
+{
+    if (!mPending)
+        return QJsonValue();
+    if (mValue.userType() != QMetaType::QByteArray)
+        return mValue.toJsonValue();
+
+    const QJsonDocument doc = QJsonDocument::fromJson(mValue.toByteArray());
+    return doc.isArray() ? QJsonValue(doc.array()) : QJsonValue(doc.object());
+}
+
+//! True if a pending container has members, without parsing its text
+bool QJsonTreeItem::hasPendingChildren() const
+{
+    if (!mPending)
+        return false;
+    if (mValue.userType() != QMetaType::QByteArray) {
+        const QJsonValue source = mValue.toJsonValue();
+        return source.isObject() ? !source.toObject().isEmpty() : !source.toArray().isEmpty();
+    }
+
+    // the text was validated on load, the first token after the bracket closes it or not
+    const QByteArray json = mValue.toByteArray();
+    for (int i = 1; i < json.size(); ++i) {
+        const char c = json.at(i);
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+            return c != '}' && c != ']';
+    }
+
+    return false;
+}
+
+QJsonValue QJsonTreeItem::takePending()
+{
+    if (!mPending)
+        return QJsonValue();
+
+    const QJsonValue source = pendingValue();
+    mValue.clear();
+    mPending = false;
+    mDisplayCached = false;
+
+    return source;
+}
+
+/**
+ * @brief QJsonTreeItem::toJsonValue
+ * Value of the subtree, scalars are converted back to their JSON type.
+ * Pending containers are filtered by exceptions like an expanded item.
+ */
+QJsonValue QJsonTreeItem::toJsonValue(const QStringList &exceptions) const
+{
+    switch (mType) {
+    case QJsonValue::Object:
+    case QJsonValue::Array: {
+        if (mPending)
+            return withoutExceptions(pendingValue(), exceptions);
+        if (mType == QJsonValue::Object) {
+            QJsonObject obj;
+            for (const QJsonTreeItem *child : mChilds)
+                obj.insert(child->mKey, child->toJsonValue(exceptions));
+            return obj;
+        }
+        QJsonArray arr;
+        for (const QJsonTreeItem *child : mChilds)
+            arr.append(child->toJsonValue(exceptions));
+        return arr;
+    }
+    case QJsonValue::Bool:
+        return mValue.toBool();
+    case QJsonValue::Double:
+        return mValue.toDouble();
+    case QJsonValue::String:
+        return mValue.toString();
+    case QJsonValue::Null:
+        return QJsonValue();
+    default:
+        return QJsonValue::fromVariant(mValue);
+    }
+}
+
+QJsonTreeItem* QJsonTreeItem::load(const QJsonValue& value, const QStringList &exceptions, QJsonTreeItem* parent,
+                                   QJsonTreeItemArena *arena)
 {
-    QJsonTreeItem * rootItem = new QJsonTreeItem(parent);
+    QJsonTreeItem * rootItem = create(parent, arena);
     rootItem->setKey("root");
 
     if (value.isObject()) {
         //Get all QJsonValue childs
-        auto keys = value.toObject().keys();
-        for (const QString &key : qAsConst(keys)) {
-            if (contains(exceptions, key)) {
+        const QJsonObject obj = value.toObject();
+        for (auto it = obj.constBegin(); it != obj.constEnd(); ++it) {
+            if (contains(exceptions, it.key())) {
                 continue;
             }
-            QJsonValue v = value.toObject().value(key);
-            QJsonTreeItem *child = load(v, exceptions, rootItem);
-            child->setKey(key);
+            QJsonValue v = it.value();
+            QJsonTreeItem *child = load(v, exceptions, rootItem, arena);
+            child->setKey(it.key());
             child->setType(v.type());
             rootItem->appendChild(child);
         }
     } else if (value.isArray()) {
         //Get all QJsonValue childs
         int index = 0;
-        auto arr = value.toArray();
+        const QJsonArray arr = value.toArray();
         for (const QJsonValue &v : arr) {
-            QJsonTreeItem *child = load(v, exceptions, rootItem);
+            QJsonTreeItem *child = load(v, exceptions, rootItem, arena);
             child->setKey(QString::number(index));
             child->setType(v.type());
             rootItem->appendChild(child);
@@ -236,51 +501,202 @@ QJsonTreeItem* QJsonTreeItem::load(const QJsonValue& value, const QStringList &e
     return rootItem;
 }
 
-QJsonTreeItem* QJsonTreeItem::loadWithDesc(const QJsonValue& value, const QJsonValue& description, const QStringList &exceptions, QJsonTreeItem * parent)
+QJsonTreeItem* QJsonTreeItem::loadLazy(const QJsonValue& value, const QStringList &exceptions, QJsonTreeItem* parent,
+                                       QJsonTreeItemArena *arena)
+{
+    QJsonTreeItem * rootItem = create(parent, arena);
+    rootItem->setKey("root");
+
+    if (value.isObject() || value.isArray()) {
+        for (QJsonTreeItem *child : loadChildren(value, exceptions, arena))
+            rootItem->appendChild(child);
+    } else {
+        rootItem->setValue(value.toVariant());
+        rootItem->setType(value.type());
+    }
+
+    return rootItem;
+}
+
+QList<QJsonTreeItem*> QJsonTreeItem::loadChildren(const QJsonValue& value, const QStringList &exceptions,
+                                                  QJsonTreeItemArena *arena)
+{
+    QList<QJsonTreeItem*> childs;
+    auto loadChild = [&](const QString &key, const QJsonValue &v) {
+        QJsonTreeItem *child = create(nullptr, arena);
+        child->setKey(key);
+        child->setType(v.type());
+        if (v.isObject() || v.isArray())
+            child->setPending(v);
+        else
+            child->setValue(v.toVariant());
+        childs.append(child);
+    };
+
+    if (value.isObject()) {
+        const QJsonObject obj = value.toObject();
+        childs.reserve(obj.count());
+        for (auto it = obj.constBegin(); it != obj.constEnd(); ++it) {
+            if (contains(exceptions, it.key())) {
+                continue;
+            }
+            loadChild(it.key(), it.value());
+        }
+    } else if (value.isArray()) {
+        const QJsonArray arr = value.toArray();
+        childs.reserve(arr.count());
+        for (int i = 0; i < arr.count(); ++i)
+            loadChild(QString::number(i), arr.at(i));
+    }
+
+    return childs;
+}
+
+namespace {
+
+//! Containers with fewer children are built serially
+const int ParallelLoadThreshold = 1024;
+
+//! Subtrees of one contiguous range of children, built by one pool task
+struct LoadChunk {
+    QList<QJsonTreeItem*> items;
+    QJsonTreeItemArena *arena = nullptr;
+};
+
+int containerSize(const QJsonValue &value)
+{
+    return value.isObject() ? value.toObject().count() : value.isArray() ? value.toArray().count() : 0;
+}
+
+QJsonTreeItem *buildParallel(const QJsonValue &value, const QStringList &exceptions, QJsonTreeItem *parent,
+                             QJsonTreeItemArena *arena, QThreadPool *pool)
+{
+    if (containerSize(value) < ParallelLoadThreshold)
+        return QJsonTreeItem::load(value, exceptions, parent, arena);
+
+    const bool isObject = value.isObject();
+    QJsonTreeItem *rootItem = QJsonTreeItem::create(parent, arena);
+    rootItem->setKey("root");
+
+    // Same children, order and filtering as QJsonTreeItem::load()
+    const QJsonObject obj = value.toObject();
+    const QJsonArray arr = value.toArray();
+    QStringList keys;
+    if (isObject) {
+        for (auto it = obj.constBegin(); it != obj.constEnd(); ++it)
+            if (!contains(exceptions, it.key()))
+                keys.append(it.key());
+    }
+    const int total = isObject ? keys.count() : arr.count();
+
+    // A few chunks per thread so that uneven records still balance
+    const int chunkCount = qMin(total, pool->maxThreadCount() * 4);
+    QVector<QFuture<LoadChunk>> futures;
+    futures.reserve(chunkCount);
+    for (int c = 0; c < chunkCount; ++c) {
+        const int first = int(qint64(total) * c / chunkCount);
+        const int last = int(qint64(total) * (c + 1) / chunkCount);
+        futures.append(QtConcurrent::run(pool, [=]() -> LoadChunk {
+            LoadChunk chunk;
+            if (arena)
+                chunk.arena = new QJsonTreeItemArena;
+            chunk.items.reserve(last - first);
+            for (int i = first; i < last; ++i) {
+                const QJsonValue v = isObject ? obj.value(keys.at(i)) : arr.at(i);
+                // Large nested containers are split in turn by the calling thread
+                if (containerSize(v) >= ParallelLoadThreshold) {
+                    chunk.items.append(nullptr);
+                    continue;
+                }
+                QJsonTreeItem *child = QJsonTreeItem::load(v, exceptions, nullptr, chunk.arena);
+                child->setKey(isObject ? keys.at(i) : QString::number(i));
+                child->setType(v.type());
+                chunk.items.append(child);
+            }
+            return chunk;
+        }));
+    }
+
+    int index = 0;
+    for (QFuture<LoadChunk> &future : futures) {
+        const LoadChunk chunk = future.result();
+        if (chunk.arena) {
+            arena->adopt(*chunk.arena);
+            delete chunk.arena;
+        }
+        for (QJsonTreeItem *child : chunk.items) {
+            if (!child) {
+                const QJsonValue v = isObject ? obj.value(keys.at(index)) : arr.at(index);
+                child = buildParallel(v, exceptions, rootItem, arena, pool);
+                child->setKey(isObject ? keys.at(index) : QString::number(index));
+                child->setType(v.type());
+            }
+            rootItem->appendChild(child);
+            ++index;
+        }
+    }
+
+    return rootItem;
+}
+
+} // namespace
+
+/**
+ * @brief QJsonTreeItem::loadParallel
+ * Builds the same tree as load(), splitting containers with many children
+ * across a pool of threads. Each task allocates from its own arena, merged
+ * into arena once the task is done.
+ * @param threads number of worker threads, 1 or less loads serially
+ */
+QJsonTreeItem* QJsonTreeItem::loadParallel(const QJsonValue& value, int threads, const QStringList &exceptions,
+                                           QJsonTreeItemArena *arena)
+{
+    if (threads <= 1)
+        return load(value, exceptions, nullptr, arena);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    return buildParallel(value, exceptions, nullptr, arena, &pool);
+}
+
+QJsonTreeItem* QJsonTreeItem::loadWithDesc(const QJsonValue& value, const QJsonValue& description, const QStringList &exceptions, QJsonTreeItem * parent,
+                                           QJsonTreeItemArena *arena)
 {
-    QJsonTreeItem * rootItem = new QJsonTreeItem(parent);
+    QJsonTreeItem * rootItem = create(parent, arena);
     rootItem->setKey("root");
 
     if (value.isObject()) {
         //Get all QJsonValue childs
-        auto keys = value.toObject().keys();
-        for (const QString &key : qAsConst(keys)) {
-            if (contains(exceptions, key)) {
+        const QJsonObject obj = value.toObject();
+        const QJsonObject descObj = description.toObject();
+        for (auto it = obj.constBegin(); it != obj.constEnd(); ++it) {
+            if (contains(exceptions, it.key())) {
                 continue;
             }
-            QJsonValue v = value.toObject().value(key);
-            QJsonValue d = description.toObject().value(key);
-            QJsonTreeItem * child = loadWithDesc(v, d, exceptions, rootItem);
-            child->setKey(key);
+            QJsonValue v = it.value();
+            QJsonValue d = descObj.value(it.key());
+            QJsonTreeItem * child = loadWithDesc(v, d, exceptions, rootItem, arena);
+            child->setKey(it.key());
             child->setType(v.type());
             rootItem->appendChild(child);
         }
     } else if (value.isArray()) {
         //Get all QJsonValue childs
-        int index = 0;
-        for (int i = 0; i < value.toArray().count(); ++i) {
-            QJsonValue v = value.toArray()[i];
-            QJsonValue d = description.toArray()[i];
-            QJsonTreeItem * child = loadWithDesc(v, d, exceptions, rootItem);
-            child->setKey(QString::number(index));
+        const QJsonArray arr = value.toArray();
+        const QJsonArray descArr = description.toArray();
+        for (int i = 0; i < arr.count(); ++i) {
+            QJsonValue v = arr.at(i);
+            QJsonValue d = descArr.at(i);
+            QJsonTreeItem * child = loadWithDesc(v, d, exceptions, rootItem, arena);
+            child->setKey(QString::number(i));
             child->setType(v.type());
             rootItem->appendChild(child);
-            ++index;
         }
     } else {
         rootItem->setValue(value.toVariant());
         rootItem->setType(value.type());
-        auto modeStr = description.toVariant().toMap()["mode2"].toString();
-        QJsonTreeItem::JsonEditMode mode = ! modeStr.contains("r", Qt::CaseInsensitive) ? QJsonTreeItem::W :
-                                           modeStr.contains("w", Qt::CaseInsensitive) ? QJsonTreeItem::RW : QJsonTreeItem::R;
-        rootItem->setEditMode(mode);
-
-        auto type = typeFromString(description.toVariant().toMap()["type"].toString());
-        rootItem->setFieldType(type);
-        bool isOk;
-        rootItem->setAddress(description.toVariant().toMap()["addr"].toString().toInt(&isOk, 16));
-        rootItem->setSize(description.toVariant().toMap()["size"].toInt(&isOk));
-        rootItem->setDescription(description.toVariant().toMap()["desc"].toString());
+        rootItem->setRegisterInfo(registerInfoFromDescription(description.toObject()));
         rootItem->setAsLeaf();
     }
 
@@ -289,44 +705,37 @@ QJsonTreeItem* QJsonTreeItem::loadWithDesc(const QJsonValue& value, const QJsonV
 
 //!< Load by description, filling fields with default values
 QJsonTreeItem* QJsonTreeItem::loadByDesc(const QJsonValue& description,
-                                         const QStringList &exceptions, QJsonTreeItem * parent)
+                                         const QStringList &exceptions, QJsonTreeItem * parent,
+                                         QJsonTreeItemArena *arena)
 {
-    QJsonTreeItem * rootItem = new QJsonTreeItem(parent);
+    QJsonTreeItem * rootItem = create(parent, arena);
     rootItem->setKey("root");
 
     if (description.isObject()) {
         //Get all QJsonValue childs
-        auto keys = description.toObject().keys();
-        for (const QString &key : qAsConst(keys)) {
+        const QJsonObject descObj = description.toObject();
+        for (auto it = descObj.constBegin(); it != descObj.constEnd(); ++it) {
+            const QString key = it.key();
             if (contains(exceptions, key)) {
                 continue;
             }
-            QJsonValue d = description.toObject().value(key);
+            QJsonValue d = it.value();
 
             if (!d.isObject()) {
-                QVariant defVal = description.toVariant().toMap()["default"];
-                bool isOk;
-                auto size = description.toVariant().toMap()["size"].toInt(&isOk);
+                // The object itself is a field description
+                const RegisterInfo info = registerInfoFromDescription(descObj);
+                QVariant defVal = descObj.value("default").toVariant();
                 rootItem->setType(d.type());
-                auto modeStr = description.toVariant().toMap()["mode2"].toString();
-                QJsonTreeItem::JsonEditMode mode = ! modeStr.contains("r", Qt::CaseInsensitive) ? QJsonTreeItem::W :
-                                                   modeStr.contains("w", Qt::CaseInsensitive) ? QJsonTreeItem::RW : QJsonTreeItem::R;
-                rootItem->setEditMode(mode);
-
-                auto type = description.toVariant().toMap()["type"].toString();
-                rootItem->setFieldType(typeFromString(type));
-                rootItem->setAddress(description.toVariant().toMap()["addr"].toString().toInt(&isOk, 16));
-                rootItem->setSize(size);
-                rootItem->setDescription(description.toVariant().toMap()["desc"].toString());
+                rootItem->setRegisterInfo(info);
                 rootItem->setAsLeaf();
                 rootItem->setKey(key);
                 if (defVal.toString().isEmpty() || !defVal.isValid() || defVal.isNull())
-                    rootItem->setValue(defaultFromString(type, size));
+                    rootItem->setValue(defaultFromString(descObj.value("type").toVariant().toString(), info.size));
                 else
                     rootItem->setValue(defVal);
                 break;
             } else {
-                QJsonTreeItem * child = loadByDesc(d, exceptions, rootItem);
+                QJsonTreeItem * child = loadByDesc(d, exceptions, rootItem, arena);
                 child->setKey(key);
                 if (!child->isLeaf())
                     child->setType(d.type());
@@ -337,39 +746,46 @@ QJsonTreeItem* QJsonTreeItem::loadByDesc(const QJsonValue& description,
         }
     } else if (description.isArray()) {
         //Get all QJsonValue childs
-        int index = 0;
-        for (int i = 0; i < description.toArray().count(); ++i) {
-            QJsonValue d = description.toArray()[i];
-            QJsonTreeItem * child = loadByDesc(d, exceptions, rootItem);
-            child->setKey(QString::number(index));
+        const QJsonArray descArr = description.toArray();
+        for (int i = 0; i < descArr.count(); ++i) {
+            QJsonValue d = descArr.at(i);
+            QJsonTreeItem * child = loadByDesc(d, exceptions, rootItem, arena);
+            child->setKey(QString::number(i));
             child->setType(d.type());
             rootItem->appendChild(child);
-            ++index;
         }
-    } else {
-        /*QVariant defVal = description.toVariant().toMap()["default"];
-        if (!defVal.toString().isEmpty())
-            rootItem->setValue(defVal);
-        else
-            rootItem->setValue(defaultFromString(defVal.toString()));
-
-        rootItem->setType(description.type());
-        auto modeStr = description.toVariant().toMap()["mode2"].toString();
-        QJsonTreeItem::JsonEditMode mode = ! modeStr.contains("r", Qt::CaseInsensitive) ? QJsonTreeItem::W :
-                                           modeStr.contains("w", Qt::CaseInsensitive) ? QJsonTreeItem::RW : QJsonTreeItem::R;
-        rootItem->setEditMode(mode);
-
-        rootItem->setFieldType(typeFromString(description.toVariant().toMap()["type"].toString()));
-        bool isOk;
-        rootItem->setAddress(description.toVariant().toMap()["addr"].toString().toInt(&isOk, 16));
-        rootItem->setSize(description.toVariant().toMap()["size"].toInt(&isOk));
-        rootItem->setDescription(description.toVariant().toMap()["desc"].toString());
-        rootItem->setAsLeaf();*/
     }
 
     return rootItem;
 }
 
+/**
+ * @brief QJsonTreeItem::registerInfoFromDescription
+ * Decodes the field description ("mode2", "type", "addr", "size", "desc") in one pass
+ * @param description JSON object describing a single field
+ * @return register metadata of the field
+ */
+QJsonTreeItem::RegisterInfo QJsonTreeItem::registerInfoFromDescription(const QJsonObject &description)
+{
+    RegisterInfo info;
+    bool isOk;
+
+    auto modeStr = description.value("mode2").toVariant().toString();
+    info.editMode = ! modeStr.contains("r", Qt::CaseInsensitive) ? QJsonTreeItem::W :
+                    modeStr.contains("w", Qt::CaseInsensitive) ? QJsonTreeItem::RW : QJsonTreeItem::R;
+    info.fieldType = typeFromString(description.value("type").toVariant().toString());
+    info.address = description.value("addr").toVariant().toString().toInt(&isOk, 16);
+    info.size = description.value("size").toVariant().toInt(&isOk);
+    info.description = description.value("desc").toVariant().toString();
+
+    return info;
+}
+
+void QJsonTreeItem::setRegisterInfo(const RegisterInfo &info)
+{
+    registerInfo() = info;
+}
+
 QJsonTreeItem::JsonFieldType QJsonTreeItem::typeFromString(const QString &str)
 {
     if (str.contains("uint", Qt::CaseInsensitive)) {
@@ -385,6 +801,8 @@ QJsonTreeItem::JsonFieldType QJsonTreeItem::typeFromString(const QString &str)
     } else if (str.contains("date", Qt::CaseInsensitive)) {
         return DATE;
     }
+
+    return STRING;
 }
 
 QVariant QJsonTreeItem::defaultFromString(const QString &str, size_t size)
@@ -402,149 +820,190 @@ QVariant QJsonTreeItem::defaultFromString(const QString &str, size_t size)
     } else if (str.contains("date", Qt::CaseInsensitive)) {
         return QDate(0, 0, 0);
     }
+
+    return QVariant();
 }
 
 QMap<QString, QVariant> QJsonTreeItem::attributeMap() const
 {
-    return mAttrMap;
+    QMap<QString, QVariant> attrMap;
+    if (mRegister) {
+        attrMap.insert(tagNames[TYPE], mRegister->fieldType);
+        attrMap.insert(tagNames[ADDR], mRegister->address);
+        attrMap.insert(tagNames[SIZE], mRegister->size);
+        attrMap.insert(tagNames[DESC], mRegister->description);
+    }
+
+    return attrMap;
 }
 
 QByteArray QJsonTreeItem::serialize() const
 {
-    QByteArray tmp;
-    tmp.resize(mLength);
-    switch(mFieldType) {
+    QByteArray tmp(size(), Qt::Uninitialized);
+    serializeTo(tmp.data());
+
+    return tmp;
+}
+
+/**
+ * @brief QJsonTreeItem::serializeTo
+ * Writes exactly size() bytes of the field into dst without allocating.
+ * Strings are truncated or zero padded to the field size.
+ * @param dst destination, at least size() bytes
+ */
+void QJsonTreeItem::serializeTo(char *dst) const
+{
+    const int length = size();
+    unsigned char *bytes = reinterpret_cast<unsigned char*>(dst);
+    memset(dst, 0, size_t(length));
+
+    switch(fieldType()) {
     case QJsonTreeItem::STRING: {
-            // tmp = value.toString().toLatin1();// toUtf8();
-            tmp = QByteArray::fromStdString(mValue.toString().toStdString());
-            if (tmp.size() < mLength) {
-                auto tail = mLength - tmp.size();
-                for (int i = 0; i < tail; ++i)
-                    tmp.append('\0');
-            }
+            const QString str = mValue.toString();
+            const QChar *chars = str.constData();
+            const int n = qMin(length, str.size());
+            for (int i = 0; i < n; ++i)
+                dst[i] = chars[i].toLatin1();
         }
         break;
     case QJsonTreeItem::INT: {
-            switch (mLength) {
-                case 1: {
-                    int8_t val = mValue.toUInt();
-                    szn::intToBytes(reinterpret_cast<unsigned char*>(tmp.data()), val);
-                } break;
-                case 2: {
-                    int16_t val = mValue.toUInt();
-                    szn::intToBytes(reinterpret_cast<unsigned char*>(tmp.data()), val);
-                } break;
-                case 4: {
-                    int32_t val = mValue.toUInt();
-                    szn::intToBytes(reinterpret_cast<unsigned char*>(tmp.data()), val);
-                } break;
+            switch (length) {
+                case 1: szn::intToBytes(bytes, int8_t(mValue.toLongLong())); break;
+                case 2: szn::intToBytes(bytes, int16_t(mValue.toLongLong())); break;
+                case 4: szn::intToBytes(bytes, int32_t(mValue.toLongLong())); break;
+                case 8: szn::intToBytes(bytes, int64_t(mValue.toLongLong())); break;
             }
         }
         break;
     case QJsonTreeItem::UINT: {
-            switch (mLength) {
-                case 1: {
-                    uint8_t val = mValue.toUInt();
-                    szn::intToBytes(reinterpret_cast<unsigned char*>(tmp.data()), val);
-                } break;
-                case 2: {
-                    uint16_t val = mValue.toUInt();
-                    szn::intToBytes(reinterpret_cast<unsigned char*>(tmp.data()), val);
-                } break;
-                case 4: {
-                    uint32_t val = mValue.toUInt();
-                    szn::intToBytes(reinterpret_cast<unsigned char*>(tmp.data()), val);
-                } break;
+            switch (length) {
+                case 1: szn::intToBytes(bytes, uint8_t(mValue.toULongLong())); break;
+                case 2: szn::intToBytes(bytes, uint16_t(mValue.toULongLong())); break;
+                case 4: szn::intToBytes(bytes, uint32_t(mValue.toULongLong())); break;
+                case 8: szn::intToBytes(bytes, uint64_t(mValue.toULongLong())); break;
             }
         }
         break;
-    case QJsonTreeItem::FLOAT: {
-            float val = mValue.toFloat();
-            szn::floatToBytes(reinterpret_cast<unsigned char*>(tmp.data()), val);
-        }
+    case QJsonTreeItem::FLOAT:
+        if (length >= int(sizeof(float)))
+            szn::floatToBytes(bytes, mValue.toFloat());
         break;
-    case QJsonTreeItem::DOUBLE: {
-            double val = mValue.toDouble();
-            szn::floatToBytes(reinterpret_cast<unsigned char*>(tmp.data()), val);
-        }
+    case QJsonTreeItem::DOUBLE:
+        if (length >= int(sizeof(double)))
+            szn::floatToBytes(bytes, mValue.toDouble());
         break;
-    case QJsonTreeItem::DATE: {
-            uint32_t val = QDateToBcd(mValue.toDate());
-            szn::intToBytes(reinterpret_cast<unsigned char*>(tmp.data()), val);
-        }
+    case QJsonTreeItem::DATE:
+        if (length >= int(sizeof(uint32_t)))
+            szn::intToBytes(bytes, QDateToBcd(mValue.toDate()));
         break;
     }
-
-    return tmp;
 }
 
 bool QJsonTreeItem::deserialize(const QByteArray &chunk)
 {
-    switch(mFieldType) {
+    return deserialize(chunk.constData(), chunk.size());
+}
+
+/**
+ * @brief QJsonTreeItem::deserialize
+ * Decodes the field from raw bytes in place, without copying the chunk.
+ * @param chunk field bytes
+ * @param length number of bytes available at chunk
+ * @param changed set to true if the value differs from the previous one
+ * @return false if fewer than size() bytes are available
+ */
+bool QJsonTreeItem::deserialize(const char *chunk, int length, bool *changed)
+{
+    const int fieldSize = size();
+    if (changed)
+        *changed = false;
+    if (length < fieldSize)
+        return false;
+
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(chunk);
+    QVariant value;
+    switch(fieldType()) {
     case QJsonTreeItem::STRING:
-        // tmp = value.toString().toLatin1();// toUtf8();
-        // tmp = QByteArray::fromStdString(mValue.toString().toStdString());
-        mValue = QString::fromLatin1(chunk);
+        // the field is zero padded, the string ends at the first NUL
+        value = QString::fromLatin1(chunk, int(qstrnlen(chunk, uint(qMax(fieldSize, 0)))));
         break;
     case QJsonTreeItem::INT: {
-        switch (mLength) {
+        switch (fieldSize) {
             case 1: {
                 int8_t val;
-                szn::bytesToInt(val, reinterpret_cast<const unsigned char*>(chunk.data()));
-                mValue = val;
+                szn::bytesToInt(val, bytes);
+                value = int(val);
             } break;
             case 2: {
                 int16_t val;
-                szn::bytesToInt(val, reinterpret_cast<const unsigned char*>(chunk.data()));
-                mValue = val;
+                szn::bytesToInt(val, bytes);
+                value = int(val);
             } break;
             case 4: {
                 int32_t val;
-                szn::bytesToInt(val, reinterpret_cast<const unsigned char*>(chunk.data()));
-                mValue = val;
+                szn::bytesToInt(val, bytes);
+                value = int(val);
+            } break;
+            case 8: {
+                int64_t val;
+                szn::bytesToInt(val, bytes);
+                value = qlonglong(val);
             } break;
         }
     } break;
     case QJsonTreeItem::UINT: {
-            // szn::intToBytes(reinterpret_cast<unsigned char*>(tmp.data()), val);
-        switch (mLength) {
+        switch (fieldSize) {
             case 1: {
                 uint8_t val;
-                szn::bytesToInt(val, reinterpret_cast<const unsigned char*>(chunk.data()));
-                mValue = val;
+                szn::bytesToInt(val, bytes);
+                value = uint(val);
             } break;
             case 2: {
                 uint16_t val;
-                szn::bytesToInt(val, reinterpret_cast<const unsigned char*>(chunk.data()));
-                mValue = val;
+                szn::bytesToInt(val, bytes);
+                value = uint(val);
             } break;
             case 4: {
                 uint32_t val;
-                szn::bytesToInt(val, reinterpret_cast<const unsigned char*>(chunk.data()));
-                mValue = val;
+                szn::bytesToInt(val, bytes);
+                value = uint(val);
+            } break;
+            case 8: {
+                uint64_t val;
+                szn::bytesToInt(val, bytes);
+                value = qulonglong(val);
             } break;
         }
     } break;
     case QJsonTreeItem::FLOAT: {
             float val = 0;
-            szn::bytesToFloat(val, reinterpret_cast<const unsigned char*>(chunk.data()));
-            mValue = val;
+            if (fieldSize >= int(sizeof(float)))
+                szn::bytesToFloat(val, bytes);
+            value = val;
         }
         break;
     case QJsonTreeItem::DOUBLE: {
             double val = 0;
-            szn::bytesToFloat(val, reinterpret_cast<const unsigned char*>(chunk.data()));
-            mValue = val;
+            if (fieldSize >= int(sizeof(double)))
+                szn::bytesToFloat(val, bytes);
+            value = val;
         }
         break;
     case QJsonTreeItem::DATE: {
             uint32_t val = 0;
-            szn::bytesToInt(val, reinterpret_cast<const unsigned char*>(chunk.data()));
-            mValue = BcdToQDate(val);
+            if (fieldSize >= int(sizeof(uint32_t)))
+                szn::bytesToInt(val, bytes);
+            value = BcdToQDate(val);
         }
         break;
     }
 
+    if (mValue != value) {
+        setValue(value);
+        if (changed)
+            *changed = true;
+    }
+
     return true;
 }
 
@@ -578,48 +1037,768 @@ bool QJsonTreeItem::deserialize(const QByteArray &chunk)
 
 //=========================================================================
 
-inline uchar hexdig(uint u)
+QJsonTreeItemArena::QJsonTreeItemArena(int slabSize)
+    : mSlabSize(qMax(1, slabSize))
 {
-    return (u < 0xa ? '0' + u : 'a' + u - 0xa);
 }
 
-QByteArray escapedString(const QString &s)
+QJsonTreeItemArena::~QJsonTreeItemArena()
 {
-    QByteArray ba(s.length(), Qt::Uninitialized);
-    uchar *cursor = reinterpret_cast<uchar *>(const_cast<char *>(ba.constData()));
-    const uchar *ba_end = cursor + ba.length();
-    const ushort *src = reinterpret_cast<const ushort *>(s.constBegin());
-    const ushort *const end = reinterpret_cast<const ushort *>(s.constEnd());
-    while (src != end) {
-        if (cursor >= ba_end - 6) {
-            // ensure we have enough space
-            int pos = cursor - (const uchar *)ba.constData();
-            ba.resize(ba.size() * 2);
-            cursor = (uchar *)ba.data() + pos;
-            ba_end = (const uchar *)ba.constData() + ba.length();
+    clear();
+}
+
+QJsonTreeItem *QJsonTreeItemArena::create(QJsonTreeItem *parent)
+{
+    QJsonTreeItem *item;
+    if (!mFree.isEmpty()) {
+        // freed slots hold a default constructed item, see destroy()
+        item = mFree.takeLast();
+        item->~QJsonTreeItem();
+    } else {
+        if (mSlabs.isEmpty() || mSlabs.last().used == mSlabSize) {
+            Slab slab;
+            slab.items = static_cast<QJsonTreeItem*>(::operator new(sizeof(QJsonTreeItem) * size_t(mSlabSize)));
+            slab.used = 0;
+            mSlabs.append(slab);
         }
-        uint u = *src++;
-        if (u < 0x80) {
-            if (u < 0x20 || u == 0x22 || u == 0x5c) {
-                *cursor++ = '\\';
-                switch (u) {
-                case 0x22:
-                    *cursor++ = '"';
-                    break;
-                case 0x5c:
-                    *cursor++ = '\\';
-                    break;
-                case 0x8:
-                    *cursor++ = 'b';
-                    break;
-                case 0xc:
-                    *cursor++ = 'f';
-                    break;
-                case 0xa:
-                    *cursor++ = 'n';
-                    break;
-                case 0xd:
-                    *cursor++ = 'r';
+        Slab &slab = mSlabs.last();
+        item = slab.items + slab.used++;
+    }
+    new (item) QJsonTreeItem(parent);
+    item->mArenaAllocated = true;
+    ++mCount;
+
+    return item;
+}
+
+void QJsonTreeItemArena::destroy(QJsonTreeItem *item)
+{
+    for (QJsonTreeItem *child : qAsConst(item->mChilds))
+        destroy(child);
+
+    // Keep the slot constructed so that clear() can sweep slabs blindly
+    item->~QJsonTreeItem();
+    new (item) QJsonTreeItem;
+    item->mArenaAllocated = true;
+    mFree.append(item);
+    --mCount;
+}
+
+void QJsonTreeItemArena::clear()
+{
+    for (const Slab &slab : qAsConst(mSlabs)) {
+        for (int i = 0; i < slab.used; ++i)
+            slab.items[i].~QJsonTreeItem();
+        ::operator delete(slab.items);
+    }
+    mSlabs.clear();
+    mFree.clear();
+    mCount = 0;
+}
+
+int QJsonTreeItemArena::count() const
+{
+    return mCount;
+}
+
+qint64 QJsonTreeItemArena::bytesAllocated() const
+{
+    return qint64(mSlabs.size()) * mSlabSize * qint64(sizeof(QJsonTreeItem));
+}
+
+void QJsonTreeItemArena::adopt(QJsonTreeItemArena &other)
+{
+    // Keep the partially used slab of this arena last, create() only fills the last one
+    if (!mSlabs.isEmpty()) {
+        const Slab current = mSlabs.takeLast();
+        mSlabs += other.mSlabs;
+        mSlabs.append(current);
+    } else {
+        mSlabs = other.mSlabs;
+    }
+    mFree += other.mFree;
+    mCount += other.mCount;
+
+    other.mSlabs.clear();
+    other.mFree.clear();
+    other.mCount = 0;
+}
+
+//=========================================================================
+
+/**
+ * @brief The JsonTreeReader class
+ * Pull parser that builds QJsonTreeItem nodes straight from JSON text, either
+ * from memory or from a device read in chunks, so no intermediate
+ * QJsonDocument is created. Members are ordered by key and duplicate keys
+ * keep their last value, as QJsonObject does, and members matching one of
+ * the exceptions are skipped without being built.
+ */
+class JsonTreeReader
+{
+public:
+    JsonTreeReader(QIODevice *device, const QStringList &exceptions, QJsonTreeItemArena *arena)
+        : mDevice(device)
+        , mExceptions(exceptions)
+        , mArena(arena)
+    {
+        mScratch.reserve(256);
+    }
+
+    JsonTreeReader(const char *data, qint64 size, const QStringList &exceptions, QJsonTreeItemArena *arena)
+        : mPos(data)
+        , mEnd(data + size)
+        , mExceptions(exceptions)
+        , mArena(arena)
+    {
+        mScratch.reserve(256);
+    }
+
+    //!< Parses the whole input, returns nullptr on error (see errorString())
+    QJsonTreeItem *read()
+    {
+        skipWhitespace();
+        int c = peek();
+        if (c != '{' && c != '[') {
+            setError("document must start with an object or an array");
+            return nullptr;
+        }
+
+        QJsonTreeItem *root = QJsonTreeItem::create(nullptr, mArena);
+        root->setKey("root");
+        bool ok = parseValue(root, 0);
+        if (ok) {
+            skipWhitespace();
+            if (peek() >= 0)
+                ok = setError("garbage at the end of the document");
+        }
+        if (!ok) {
+            release(root);
+            return nullptr;
+        }
+
+        return root;
+    }
+
+    QString errorString() const
+    {
+        return mError;
+    }
+
+    //!< Called after every chunk read from the device with the total number of bytes read, returning false cancels parsing
+    void setProgressHandler(const std::function<bool(qint64)> &handler)
+    {
+        mProgress = handler;
+    }
+
+    //!< Containers below the first level are validated and kept as text, for in-memory input only
+    void setLazy(bool lazy)
+    {
+        mLazy = lazy && !mDevice;
+    }
+
+private:
+    enum { ChunkSize = 64 * 1024, MaxDepth = 1024 };
+
+    bool fill()
+    {
+        if (!mDevice)
+            return false;
+        mChunk.resize(ChunkSize);
+        const qint64 n = mDevice->read(mChunk.data(), ChunkSize);
+        if (n <= 0) {
+            mChunk.clear();
+            mPos = mEnd = nullptr;
+            return false;
+        }
+        mBytesRead += n;
+        if (mProgress && !mProgress(mBytesRead)) {
+            mPos = mEnd = nullptr;
+            return setError("loading cancelled");
+        }
+        mPos = mChunk.constData();
+        mEnd = mPos + n;
+        return true;
+    }
+
+    inline int peek()
+    {
+        if (mPos == mEnd && !fill())
+            return -1;
+        return uchar(*mPos);
+    }
+
+    inline int next()
+    {
+        int c = peek();
+        if (c >= 0)
+            ++mPos;
+        return c;
+    }
+
+    void skipWhitespace()
+    {
+        for (;;) {
+            int c = peek();
+            if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+                return;
+            ++mPos;
+        }
+    }
+
+    bool setError(const char *message)
+    {
+        if (mError.isEmpty())
+            mError = QString::fromLatin1(message);
+        return false;
+    }
+
+    void release(QJsonTreeItem *item)
+    {
+        if (mArena)
+            mArena->destroy(item);
+        else
+            delete item;
+    }
+
+    //!< Attaches parsed members to item, even after an error so that they are released with it
+    static void attach(QJsonTreeItem *item, QVector<QJsonTreeItem*> &children)
+    {
+        for (QJsonTreeItem *child : qAsConst(children))
+            item->appendChild(child);
+        children.clear();
+    }
+
+    bool parseValue(QJsonTreeItem *item, int depth)
+    {
+        skipWhitespace();
+        switch (peek()) {
+        case '{':
+            if (mLazy && depth > 0)
+                return parsePending(item, depth);
+            return parseObject(item, depth + 1);
+        case '[':
+            if (mLazy && depth > 0)
+                return parsePending(item, depth);
+            return parseArray(item, depth + 1);
+        case '"': {
+            QString str;
+            if (!parseString(&str))
+                return false;
+            item->setValue(str);
+            item->setType(QJsonValue::String);
+            return true;
+        }
+        case 't':
+            item->setValue(true);
+            item->setType(QJsonValue::Bool);
+            return parseLiteral("true");
+        case 'f':
+            item->setValue(false);
+            item->setType(QJsonValue::Bool);
+            return parseLiteral("false");
+        case 'n':
+            item->setValue(QJsonValue(QJsonValue::Null).toVariant());
+            item->setType(QJsonValue::Null);
+            return parseLiteral("null");
+        case -1:
+            return setError("unexpected end of document");
+        default: {
+            QVariant number;
+            if (!parseNumber(&number))
+                return false;
+            item->setValue(number);
+            item->setType(QJsonValue::Double);
+            return true;
+        }
+        }
+    }
+
+    bool parseObject(QJsonTreeItem *item, int depth)
+    {
+        if (depth > MaxDepth)
+            return setError("document too deeply nested");
+        next(); // '{'
+        item->setType(QJsonValue::Object);
+
+        skipWhitespace();
+        if (peek() == '}') {
+            next();
+            return true;
+        }
+
+        QVector<QJsonTreeItem*> children;
+        for (;;) {
+            skipWhitespace();
+            if (peek() != '"') {
+                attach(item, children);
+                return setError("object member name expected");
+            }
+            QString key;
+            if (!parseString(&key)) {
+                attach(item, children);
+                return false;
+            }
+            skipWhitespace();
+            if (next() != ':') {
+                attach(item, children);
+                return setError("':' expected after object member name");
+            }
+
+            if (contains(mExceptions, key)) {
+                if (!skipValue(depth)) {
+                    attach(item, children);
+                    return false;
+                }
+            } else {
+                QJsonTreeItem *child = QJsonTreeItem::create(item, mArena);
+                child->setKey(key);
+                children.append(child);
+                if (!parseValue(child, depth)) {
+                    attach(item, children);
+                    return false;
+                }
+            }
+
+            skipWhitespace();
+            int c = next();
+            if (c == '}')
+                break;
+            if (c != ',') {
+                attach(item, children);
+                return setError("',' or '}' expected in object");
+            }
+        }
+
+        // Same member order as QJsonObject, the last of duplicate keys wins
+        std::stable_sort(children.begin(), children.end(), [](const QJsonTreeItem *a, const QJsonTreeItem *b) {
+            return a->key() < b->key();
+        });
+        for (int i = 0; i < children.size(); ++i) {
+            if (i + 1 < children.size() && children.at(i)->key() == children.at(i + 1)->key())
+                release(children.at(i));
+            else
+                item->appendChild(children.at(i));
+        }
+
+        return true;
+    }
+
+    bool parseArray(QJsonTreeItem *item, int depth)
+    {
+        if (depth > MaxDepth)
+            return setError("document too deeply nested");
+        next(); // '['
+        item->setType(QJsonValue::Array);
+
+        skipWhitespace();
+        if (peek() == ']') {
+            next();
+            return true;
+        }
+
+        for (int index = 0; ; ++index) {
+            QJsonTreeItem *child = QJsonTreeItem::create(item, mArena);
+            child->setKey(QString::number(index));
+            item->appendChild(child);
+            if (!parseValue(child, depth))
+                return false;
+
+            skipWhitespace();
+            int c = next();
+            if (c == ']')
+                return true;
+            if (c != ',')
+                return setError("',' or ']' expected in array");
+        }
+    }
+
+    //!< Validates a nested container and keeps its text, the children are created by fetchMore()
+    bool parsePending(QJsonTreeItem *item, int depth)
+    {
+        const char *begin = mPos;
+        item->setType(*begin == '{' ? QJsonValue::Object : QJsonValue::Array);
+        if (!skipValue(depth))
+            return false;
+        item->setPending(QByteArray(begin, int(mPos - begin)));
+
+        return true;
+    }
+
+    //!< Validates a value without building items, used for skipped members
+    bool skipValue(int depth)
+    {
+        skipWhitespace();
+        switch (peek()) {
+        case '{':
+        case '[': {
+            if (depth + 1 > MaxDepth)
+                return setError("document too deeply nested");
+            const bool isObject = next() == '{';
+            const char close = isObject ? '}' : ']';
+            skipWhitespace();
+            if (peek() == close) {
+                next();
+                return true;
+            }
+            for (;;) {
+                if (isObject) {
+                    skipWhitespace();
+                    if (peek() != '"')
+                        return setError("object member name expected");
+                    if (!parseString(nullptr))
+                        return false;
+                    skipWhitespace();
+                    if (next() != ':')
+                        return setError("':' expected after object member name");
+                }
+                if (!skipValue(depth + 1))
+                    return false;
+                skipWhitespace();
+                int c = next();
+                if (c == close)
+                    return true;
+                if (c != ',')
+                    return setError("missing separator in container");
+            }
+        }
+        case '"':
+            return parseString(nullptr);
+        case 't':
+            return parseLiteral("true");
+        case 'f':
+            return parseLiteral("false");
+        case 'n':
+            return parseLiteral("null");
+        case -1:
+            return setError("unexpected end of document");
+        default:
+            return parseNumber(nullptr);
+        }
+    }
+
+    bool parseLiteral(const char *word)
+    {
+        for (const char *c = word; *c; ++c) {
+            if (next() != uchar(*c))
+                return setError("invalid literal");
+        }
+        return true;
+    }
+
+    bool parseNumber(QVariant *out)
+    {
+        mNumber.resize(0);
+        for (;;) {
+            int c = peek();
+            if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+                mNumber += char(c);
+                ++mPos;
+            } else {
+                break;
+            }
+        }
+
+        // number = [ "-" ] ( "0" / 1-9 *DIGIT ) [ "." 1*DIGIT ] [ ( "e" / "E" ) [ "+" / "-" ] 1*DIGIT ]
+        const char *p = mNumber.constData();
+        const char *end = p + mNumber.size();
+        bool isInteger = true;
+        if (p < end && *p == '-')
+            ++p;
+        if (p < end && *p == '0') {
+            ++p;
+        } else if (p < end && *p >= '1' && *p <= '9') {
+            while (p < end && *p >= '0' && *p <= '9')
+                ++p;
+        } else {
+            return setError("invalid number");
+        }
+        if (p < end && *p == '.') {
+            isInteger = false;
+            const char *digits = ++p;
+            while (p < end && *p >= '0' && *p <= '9')
+                ++p;
+            if (p == digits)
+                return setError("invalid number");
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            isInteger = false;
+            ++p;
+            if (p < end && (*p == '+' || *p == '-'))
+                ++p;
+            const char *digits = p;
+            while (p < end && *p >= '0' && *p <= '9')
+                ++p;
+            if (p == digits)
+                return setError("invalid number");
+        }
+        if (p != end)
+            return setError("invalid number");
+
+        if (out) {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+            // Qt 6 keeps integers that fit in 64 bits as integers
+            bool isOk = false;
+            if (isInteger) {
+                const qlonglong n = mNumber.toLongLong(&isOk);
+                if (isOk)
+                    *out = n;
+            }
+            if (!isOk)
+                *out = mNumber.toDouble();
+#else
+            Q_UNUSED(isInteger)
+            *out = mNumber.toDouble();
+#endif
+        }
+
+        return true;
+    }
+
+    //!< Parses a string literal, with out == nullptr the string is only validated
+    bool parseString(QString *out)
+    {
+        next(); // '"'
+        mScratch.resize(0);
+        for (;;) {
+            // copy the run of plain bytes in the current chunk at once
+            const char *run = mPos;
+            while (mPos != mEnd && *mPos != '"' && *mPos != '\\' && uchar(*mPos) >= 0x20)
+                ++mPos;
+            if (out && mPos != run)
+                mScratch.append(run, int(mPos - run));
+
+            int c = peek();
+            if (c == '"') {
+                ++mPos;
+                if (out)
+                    out->append(QString::fromUtf8(mScratch));
+                return true;
+            }
+            if (c < 0)
+                return setError("unterminated string");
+            if (c < 0x20)
+                return setError("control character in string");
+            if (c != '\\')
+                continue; // the chunk ended inside the run
+
+            ++mPos;
+            // UTF-8 collected so far is decoded before appending the escaped unit
+            if (out) {
+                out->append(QString::fromUtf8(mScratch));
+                mScratch.resize(0);
+            }
+            ushort unit;
+            switch (next()) {
+            case '"': unit = '"'; break;
+            case '\\': unit = '\\'; break;
+            case '/': unit = '/'; break;
+            case 'b': unit = '\b'; break;
+            case 'f': unit = '\f'; break;
+            case 'n': unit = '\n'; break;
+            case 'r': unit = '\r'; break;
+            case 't': unit = '\t'; break;
+            case 'u': {
+                unit = 0;
+                for (int i = 0; i < 4; ++i) {
+                    int h = next();
+                    if (h >= '0' && h <= '9')
+                        unit = ushort(unit * 16 + h - '0');
+                    else if (h >= 'a' && h <= 'f')
+                        unit = ushort(unit * 16 + h - 'a' + 10);
+                    else if (h >= 'A' && h <= 'F')
+                        unit = ushort(unit * 16 + h - 'A' + 10);
+                    else
+                        return setError("invalid unicode escape");
+                }
+                break;
+            }
+            default:
+                return setError("invalid escape sequence");
+            }
+            if (out)
+                out->append(QChar(unit));
+        }
+    }
+
+    QIODevice *mDevice = nullptr;
+    std::function<bool(qint64)> mProgress;
+    qint64 mBytesRead = 0;
+    QByteArray mChunk;
+    const char *mPos = nullptr;
+    const char *mEnd = nullptr;
+    QStringList mExceptions;
+    QJsonTreeItemArena *mArena;
+    QByteArray mScratch;
+    QByteArray mNumber;
+    QString mError;
+    bool mLazy = false;
+};
+
+QJsonTreeItem *QJsonTreeItem::loadStream(QIODevice *device, const QStringList &exceptions,
+                                         QJsonTreeItemArena *arena, QString *errorString,
+                                         const std::function<bool(qint64)> &progress)
+{
+    JsonTreeReader reader(device, exceptions, arena);
+    reader.setProgressHandler(progress);
+    QJsonTreeItem *root = reader.read();
+    if (!root && errorString)
+        *errorString = reader.errorString();
+
+    return root;
+}
+
+QJsonTreeItem *QJsonTreeItem::loadStream(const char *data, qint64 size, const QStringList &exceptions,
+                                         QJsonTreeItemArena *arena, QString *errorString)
+{
+    JsonTreeReader reader(data, size, exceptions, arena);
+    QJsonTreeItem *root = reader.read();
+    if (!root && errorString)
+        *errorString = reader.errorString();
+
+    return root;
+}
+
+/**
+ * @brief QJsonTreeItem::loadLazy
+ * Builds the first level of JSON text. The whole text is validated in one
+ * pass, but nested containers only keep a copy of their text, which is parsed
+ * when takePendingChildren() creates their children.
+ */
+QJsonTreeItem *QJsonTreeItem::loadLazy(const char *data, qint64 size, const QStringList &exceptions,
+                                       QJsonTreeItemArena *arena, QString *errorString)
+{
+    JsonTreeReader reader(data, size, exceptions, arena);
+    reader.setLazy(true);
+    QJsonTreeItem *root = reader.read();
+    if (!root && errorString)
+        *errorString = reader.errorString();
+
+    return root;
+}
+
+/**
+ * @brief QJsonTreeItem::takePendingChildren
+ * Creates the parentless children of a pending container, which stops being
+ * pending. Their own containers stay pending.
+ */
+QList<QJsonTreeItem*> QJsonTreeItem::takePendingChildren(const QStringList &exceptions, QJsonTreeItemArena *arena)
+{
+    if (!mPending)
+        return QList<QJsonTreeItem*>();
+    if (mValue.userType() != QMetaType::QByteArray)
+        return loadChildren(takePending(), exceptions, arena);
+
+    const QByteArray json = mValue.toByteArray();
+    mValue.clear();
+    mPending = false;
+    mDisplayCached = false;
+
+    QString error;
+    QJsonTreeItem *source = loadLazy(json.constData(), json.size(), exceptions, arena, &error);
+    if (!source) {
+        qDebug()<<Q_FUNC_INFO<<"cannot parse pending container:"<<error;
+        return QList<QJsonTreeItem*>();
+    }
+    const QList<QJsonTreeItem*> childs = source->takeChildren(0, source->childCount());
+    if (source->isArenaAllocated())
+        arena->destroy(source);
+    else
+        delete source;
+
+    return childs;
+}
+
+//=========================================================================
+
+inline uchar hexdig(uint u)
+{
+    return (u < 0xa ? '0' + u : 'a' + u - 0xa);
+}
+
+#ifdef QJSONMODEL_SSE2
+//!< Bit mask (two bits per lane) of the UTF-16 units that are not printable ASCII, '"' or '\\'
+static inline int unsafeMask(__m128i data)
+{
+    const __m128i zero = _mm_setzero_si128();
+    // saturating subtractions are non zero exactly for u > 0x7f and for u < 0x20
+    const __m128i outside = _mm_or_si128(_mm_subs_epu16(data, _mm_set1_epi16(0x7f)),
+                                         _mm_subs_epu16(_mm_set1_epi16(0x20), data));
+    const __m128i special = _mm_or_si128(_mm_cmpeq_epi16(data, _mm_set1_epi16(0x22)),
+                                         _mm_cmpeq_epi16(data, _mm_set1_epi16(0x5c)));
+    const __m128i safe = _mm_andnot_si128(special, _mm_cmpeq_epi16(outside, zero));
+    return _mm_movemask_epi8(safe) ^ 0xffff;
+}
+#endif
+
+/**
+ * @brief escapedString
+ * Body of a JSON string literal in UTF-8, without the quotes. Runs that need
+ * no escaping are copied 8 units at a time where SSE2 is available.
+ */
+QByteArray escapedString(const QString &s)
+{
+    QByteArray ba(s.length() + 16, Qt::Uninitialized);
+    uchar *cursor = reinterpret_cast<uchar *>(const_cast<char *>(ba.constData()));
+    const uchar *ba_end = cursor + ba.length();
+    const ushort *src = reinterpret_cast<const ushort *>(s.constBegin());
+    const ushort *const end = reinterpret_cast<const ushort *>(s.constEnd());
+
+    // ensure we have room for n more bytes
+    auto reserve = [&](int n) {
+        if (ba_end - cursor < n) {
+            int pos = cursor - (const uchar *)ba.constData();
+            ba.resize(ba.size() * 2 + n);
+            cursor = (uchar *)ba.data() + pos;
+            ba_end = (const uchar *)ba.constData() + ba.length();
+        }
+    };
+
+    while (src != end) {
+#ifdef QJSONMODEL_SSE2
+        // Copy runs that need no escaping 8 units at a time, narrowed to bytes
+        while (end - src >= 8) {
+            reserve(8);
+            const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+            const int mask = unsafeMask(data);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(cursor), _mm_packus_epi16(data, data));
+            if (mask == 0) {
+                src += 8;
+                cursor += 8;
+                continue;
+            }
+            // keep the safe prefix, the rest is handled one unit at a time
+            const int n = qCountTrailingZeroBits(uint(mask)) / 2;
+            src += n;
+            cursor += n;
+            break;
+        }
+        if (src == end)
+            break;
+#endif
+        reserve(6);
+        uint u = *src++;
+        if (u < 0x80) {
+            if (u < 0x20 || u == 0x22 || u == 0x5c) {
+                *cursor++ = '\\';
+                switch (u) {
+                case 0x22:
+                    *cursor++ = '"';
+                    break;
+                case 0x5c:
+                    *cursor++ = '\\';
+                    break;
+                case 0x8:
+                    *cursor++ = 'b';
+                    break;
+                case 0xc:
+                    *cursor++ = 'f';
+                    break;
+                case 0xa:
+                    *cursor++ = 'n';
+                    break;
+                case 0xd:
+                    *cursor++ = 'r';
                     break;
                 case 0x9:
                     *cursor++ = 't';
@@ -648,6 +1827,88 @@ QByteArray escapedString(const QString &s)
     return ba;
 }
 
+//! Trigram index over the keys and values of the items, see QJsonModel::search()
+struct QJsonModel::SearchIndex {
+    QVector<QJsonTreeItem*> items;
+    QVector<QString> texts;                 //!< Lower case "key\nvalue" of each item
+    QHash<quint64, QVector<int>> trigrams;  //!< Entries holding each trigram
+    QHash<const QJsonTreeItem*, int> entries;
+    QVector<int> freeEntries;               //!< Entries of removed items, reused by add()
+    int generation = 0;
+
+    static quint64 trigram(const QChar *c)
+    {
+        return (quint64(c[0].unicode()) << 32) | (quint64(c[1].unicode()) << 16) | c[2].unicode();
+    }
+
+    //!< Distinct trigrams of the text of entry
+    QVector<quint64> gramsOf(int entry) const
+    {
+        const QString &text = texts.at(entry);
+        QVector<quint64> grams;
+        grams.reserve(text.size());
+        for (int i = 0; i + 3 <= text.size(); ++i)
+            grams.append(trigram(text.constData() + i));
+        std::sort(grams.begin(), grams.end());
+        grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+        return grams;
+    }
+
+    void addTrigrams(int entry)
+    {
+        for (quint64 gram : gramsOf(entry))
+            trigrams[gram].append(entry);
+    }
+
+    void removeTrigrams(int entry)
+    {
+        for (quint64 gram : gramsOf(entry)) {
+            auto it = trigrams.find(gram);
+            if (it == trigrams.end())
+                continue;
+            it->removeOne(entry);
+            if (it->isEmpty())
+                trigrams.erase(it);
+        }
+    }
+
+    //!< Replaces the text of entry, postings of the old text are dropped first
+    void setText(int entry, const QString &key, const QVariant &value)
+    {
+        removeTrigrams(entry);
+        texts[entry] = (key + QLatin1Char('\n') + value.toString()).toLower();
+        addTrigrams(entry);
+    }
+
+    void add(QJsonTreeItem *item, const QString &key)
+    {
+        int entry;
+        if (freeEntries.isEmpty()) {
+            entry = items.size();
+            items.append(item);
+            texts.append(QString());
+        } else {
+            entry = freeEntries.takeLast();
+            items[entry] = item;
+        }
+        entries.insert(item, entry);
+        setText(entry, key, item->value());
+    }
+
+    void remove(const QJsonTreeItem *item)
+    {
+        auto it = entries.find(item);
+        if (it == entries.end())
+            return;
+        const int entry = it.value();
+        entries.erase(it);
+        removeTrigrams(entry);
+        texts[entry].clear();
+        items[entry] = nullptr;
+        freeEntries.append(entry);
+    }
+};
+
 QJsonModel::QJsonModel(QObject *parent)
     : QAbstractItemModel(parent)
     , mRootItem{new QJsonTreeItem}
@@ -689,15 +1950,41 @@ QJsonModel::QJsonModel(const QByteArray& json, QObject *parent)
 
 QJsonModel::~QJsonModel()
 {
-    delete mRootItem;
+    if (mLoadPending) {
+        // also releases a finished result that finishAsyncLoad() did not take yet
+        mCancelLoad.storeRelease(1);
+        mLoadWatcher->waitForFinished();
+        discardLoadResult(mLoadWatcher->result());
+    }
+    if (mSearchPending) {
+        // also releases a finished index that finishSearchIndex() did not take yet
+        mSearchWatcher->waitForFinished();
+        delete mSearchWatcher->result();
+    }
+    releaseTree();
+    delete mArena;
 }
 
+/**
+ * @brief QJsonModel::load
+ * Parses the file in place through a read-only mapping, files that cannot be
+ * mapped are read through load(QIODevice*). Values are decoded into the items
+ * while loading, so nothing refers to the mapping once it returns.
+ */
 bool QJsonModel::load(const QString &fileName)
 {
     QFile file(fileName);
     bool success = false;
     if (file.open(QIODevice::ReadOnly)) {
-        success = load(&file);
+        const qint64 size = file.size();
+        uchar *mapped = size > 0 && size <= std::numeric_limits<int>::max() ? file.map(0, size) : nullptr;
+        if (mapped) {
+            // fromRawData() wraps the mapping without copying it
+            success = loadJson(QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), int(size)));
+            file.unmap(mapped);
+        } else {
+            success = load(&file);
+        }
         file.close();
     }
     else success = false;
@@ -736,7 +2023,14 @@ bool QJsonModel::loadDescription(const QString& descFileName)
 
 bool QJsonModel::load(QIODevice *device)
 {
-    return loadJson(device->readAll());
+    if (mLazyLoading || mLoadThreads > 1)
+        return loadJson(device->readAll());
+
+    QJsonTreeItemArena *arena = mArenaEnabled ? new QJsonTreeItemArena : nullptr;
+    QString error;
+    QJsonTreeItem *root = QJsonTreeItem::loadStream(device, mExceptions, arena, &error);
+
+    return setRootItem(root, arena, error);
 }
 
 bool QJsonModel::load(QIODevice * device, QIODevice * deviceDesc)
@@ -751,24 +2045,140 @@ bool QJsonModel::loadDescription(QIODevice * deviceDesc)
 
 bool QJsonModel::loadJson(const QByteArray &json)
 {
-    auto const& jdoc = QJsonDocument::fromJson(json);
-
-    if (!jdoc.isNull()) {
-        beginResetModel();
-        delete mRootItem;
-        if (jdoc.isArray()) {
-            mRootItem = QJsonTreeItem::load(QJsonValue(jdoc.array()), mExceptions);
-            mRootItem->setType(QJsonValue::Array);
+    QJsonTreeItemArena *arena = mArenaEnabled ? new QJsonTreeItemArena : nullptr;
+    QString error;
+    QJsonTreeItem *root = nullptr;
+    if (mLazyLoading) {
+        root = QJsonTreeItem::loadLazy(json.constData(), json.size(), mExceptions, arena, &error);
+    } else if (mLoadThreads > 1) {
+        QJsonParseError parseError;
+        const QJsonDocument doc = QJsonDocument::fromJson(json, &parseError);
+        if (!doc.isNull()) {
+            const QJsonValue value = doc.isArray() ? QJsonValue(doc.array()) : QJsonValue(doc.object());
+            root = QJsonTreeItem::loadParallel(value, mLoadThreads, mExceptions, arena);
+            root->setType(doc.isArray() ? QJsonValue::Array : QJsonValue::Object);
         } else {
-            mRootItem = QJsonTreeItem::load(QJsonValue(jdoc.object()), mExceptions);
-            mRootItem->setType(QJsonValue::Object);
+            error = parseError.errorString();
         }
-        endResetModel();
-        return true;
+    } else {
+        root = QJsonTreeItem::loadStream(json.constData(), json.size(), mExceptions, arena, &error);
     }
 
-    qDebug()<<Q_FUNC_INFO<<"cannot load json";
-    return false;
+    return setRootItem(root, arena, error);
+}
+
+/**
+ * @brief QJsonModel::loadAsync
+ * Parses the file and builds the tree on a worker thread. Progress is reported
+ * through loadProgress(), emitted from the worker thread, and the finished tree
+ * replaces the current one on the model's thread before loadFinished() is emitted.
+ * @return false if another asynchronous load is still running
+ */
+bool QJsonModel::loadAsync(const QString &fileName)
+{
+    if (isLoading())
+        return false;
+
+    if (!mLoadWatcher) {
+        mLoadWatcher = new QFutureWatcher<LoadResult>(this);
+        connect(mLoadWatcher, &QFutureWatcher<LoadResult>::finished, this, &QJsonModel::finishAsyncLoad);
+    }
+
+    mCancelLoad.storeRelease(0);
+    mLoadPending = true;
+    QJsonTreeItemArena *arena = mArenaEnabled ? new QJsonTreeItemArena : nullptr;
+    const QStringList exceptions = mExceptions;
+
+    mLoadWatcher->setFuture(QtConcurrent::run([this, fileName, exceptions, arena]() -> LoadResult {
+        LoadResult result;
+        result.arena = arena;
+        result.root = nullptr;
+
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly)) {
+            result.error = file.errorString();
+            return result;
+        }
+
+        const qint64 total = file.size();
+        int percent = -1;
+        auto progress = [this, total, percent](qint64 bytesRead) mutable {
+            // report whole percents only, chunks are far more frequent
+            const int current = total > 0 ? int(bytesRead * 100 / total) : 0;
+            if (current != percent) {
+                percent = current;
+                emit loadProgress(bytesRead, total);
+            }
+            return mCancelLoad.loadAcquire() == 0;
+        };
+        result.root = QJsonTreeItem::loadStream(&file, exceptions, arena, &result.error, progress);
+
+        return result;
+    }));
+
+    return true;
+}
+
+//! Requests cancellation of a running asynchronous load, loadFinished(false) follows
+void QJsonModel::cancelLoad()
+{
+    mCancelLoad.storeRelease(1);
+}
+
+//! True from loadAsync() until loadFinished(), including a finished load not delivered yet
+bool QJsonModel::isLoading() const
+{
+    return mLoadPending;
+}
+
+void QJsonModel::finishAsyncLoad()
+{
+    if (!mLoadPending)
+        return;
+
+    mLoadPending = false;
+    LoadResult result = mLoadWatcher->result();
+    bool success = false;
+    if (mCancelLoad.loadAcquire())
+        discardLoadResult(result);
+    else
+        success = setRootItem(result.root, result.arena, result.error);
+
+    emit loadFinished(success);
+}
+
+void QJsonModel::discardLoadResult(const LoadResult &result)
+{
+    if (result.arena)
+        delete result.arena;
+    else
+        delete result.root;
+}
+
+/**
+ * @brief QJsonModel::setRootItem
+ * Replaces the tree by root, built in its own arena (or on the heap if arena is null).
+ * On a failed parse (root is null) the current tree is kept and the arena is freed.
+ */
+bool QJsonModel::setRootItem(QJsonTreeItem *root, QJsonTreeItemArena *arena, const QString &error)
+{
+    if (!root) {
+        delete arena;
+        qDebug()<<Q_FUNC_INFO<<"cannot load json:"<<error;
+        return false;
+    }
+
+    beginResetModel();
+    releaseTree();
+    if (arena) {
+        delete mArena;
+        mArena = arena;
+    }
+    mRootItem = root;
+    endResetModel();
+    buildSearchIndex();
+
+    return true;
 }
 
 bool QJsonModel::loadJson(const QByteArray& json, const QByteArray& descJson)
@@ -778,15 +2188,16 @@ bool QJsonModel::loadJson(const QByteArray& json, const QByteArray& descJson)
 
     if (!jdoc.isNull()) {
         beginResetModel();
-        delete mRootItem;
+        releaseTree();
         if (jdoc.isArray()) {
-            mRootItem = QJsonTreeItem::loadWithDesc(QJsonValue(jdoc.array()), QJsonValue(jdocDesc.array()), mExceptions);
+            mRootItem = QJsonTreeItem::loadWithDesc(QJsonValue(jdoc.array()), QJsonValue(jdocDesc.array()), mExceptions, nullptr, treeArena());
             mRootItem->setType(QJsonValue::Array);
         } else {
-            mRootItem = QJsonTreeItem::loadWithDesc(QJsonValue(jdoc.object()), QJsonValue(jdocDesc.object()), mExceptions);
+            mRootItem = QJsonTreeItem::loadWithDesc(QJsonValue(jdoc.object()), QJsonValue(jdocDesc.object()), mExceptions, nullptr, treeArena());
             mRootItem->setType(QJsonValue::Object);
         }
         endResetModel();
+        buildSearchIndex();
         return true;
     }
 
@@ -800,15 +2211,16 @@ bool QJsonModel::loadJsonByDescription(const QByteArray& descJson)
 
     if (!jdocDesc.isNull()) {
         beginResetModel();
-        delete mRootItem;
+        releaseTree();
         if (jdocDesc.isArray()) {
-            mRootItem = QJsonTreeItem::loadByDesc(QJsonValue(jdocDesc.array()), mExceptions);
+            mRootItem = QJsonTreeItem::loadByDesc(QJsonValue(jdocDesc.array()), mExceptions, nullptr, treeArena());
             mRootItem->setType(QJsonValue::Array);
         } else {
-            mRootItem = QJsonTreeItem::loadByDesc(QJsonValue(jdocDesc.object()), mExceptions);
+            mRootItem = QJsonTreeItem::loadByDesc(QJsonValue(jdocDesc.object()), mExceptions, nullptr, treeArena());
             mRootItem->setType(QJsonValue::Object);
         }
         endResetModel();
+        buildSearchIndex();
         return true;
     }
 
@@ -818,27 +2230,29 @@ bool QJsonModel::loadJsonByDescription(const QByteArray& descJson)
 
 QVariant QJsonModel::data(const QModelIndex &index, int role) const
 {
-    if (role == Qt::EditRole) {
-        // breakpoint!
-        // qDebug() << "Qt::EditRole! " << index;
-        std::cout << "Qt::EditRole! " << index.column() << " " << index.row();
-    }
-
     if (!index.isValid())
         return QVariant();
 
     QJsonTreeItem *item = static_cast<QJsonTreeItem*>(index.internalPointer());
 
     if (role == Qt::DisplayRole) {
+        // Shared strings, so that repaints do not format anything
         if (index.column() == 0)
-            return QString("%1").arg(item->key());
+            return item->key();
 
         if (index.column() == 1)
-            return item->value();
+            return item->displayValue();
     } else if (Qt::EditRole == role) {
         if (index.column() == 1) {
             return item->value();
         }
+    } else if (Qt::UserRole == role) {
+        // Sort role of QJsonFilterProxyModel, raw values so that numbers sort by value
+        if (index.column() == 0)
+            return item->key();
+
+        if (index.column() == 1)
+            return item->value();
     } else if (Qt::ToolTipRole == role) {
         return item->description();
     }
@@ -865,42 +2279,235 @@ QValidator::State asciiValidator::validate(QString &str, int &) const
     return QValidator::Acceptable;
 }
 
-int uintLimit(int size) {
+rangeValidator::rangeValidator(qint64 min, quint64 max, QObject *parent) :
+    QValidator(parent),
+    mMin(min),
+    mMax(max)
+{
+}
+
+//!< True if value holds decimal digits only
+static bool isDigits(const QString &value)
+{
+    for (const QChar c : value)
+        if (!c.isDigit())
+            return false;
+
+    return !value.isEmpty();
+}
+
+QValidator::State rangeValidator::validate(QString &str, int &) const
+{
+    const QString value = str.trimmed();
+    const bool negative = value.startsWith('-');
+    const QString digits = value.mid(negative || value.startsWith('+') ? 1 : 0);
+    if (digits.isEmpty())
+        return negative && mMin >= 0 ? QValidator::Invalid : QValidator::Intermediate;
+    if (!isDigits(digits) || (negative && mMin >= 0))
+        return QValidator::Invalid;
+
+    // out of range values may still be fixed by deleting digits
+    bool ok;
+    if (negative) {
+        const qint64 v = value.toLongLong(&ok);
+        return ok && v >= mMin ? QValidator::Acceptable : QValidator::Intermediate;
+    }
+    const quint64 v = digits.toULongLong(&ok);
+    return ok && v <= mMax ? QValidator::Acceptable : QValidator::Intermediate;
+}
+
+quint64 uintLimit(int size) {
     switch (size) {
     case 1:
         return std::numeric_limits<uint8_t>::max();
     case 2:
         return std::numeric_limits<uint16_t>::max();
-    case 4:
-        return std::numeric_limits<uint32_t>::max();
     case 8:
         return std::numeric_limits<uint64_t>::max();
+    case 4:
+    default:
+        return std::numeric_limits<uint32_t>::max();
     }
 }
 
-int intMaxLimit(int size) {
+qint64 intMaxLimit(int size) {
     switch (size) {
     case 1:
         return std::numeric_limits<int8_t>::max();
     case 2:
         return std::numeric_limits<int16_t>::max();
-    case 4:
-        return std::numeric_limits<int32_t>::max();
     case 8:
         return std::numeric_limits<int64_t>::max();
+    case 4:
+    default:
+        return std::numeric_limits<int32_t>::max();
     }
 }
 
-int intMinLimit(int size) {
+qint64 intMinLimit(int size) {
     switch (size) {
     case 1:
         return std::numeric_limits<int8_t>::min();
     case 2:
         return std::numeric_limits<int16_t>::min();
-    case 4:
-        return std::numeric_limits<int32_t>::min();
     case 8:
         return std::numeric_limits<int64_t>::min();
+    case 4:
+    default:
+        return std::numeric_limits<int32_t>::min();
+    }
+}
+
+/**
+ * @brief QJsonModel::validator
+ * Validator of the field at index, shared by all fields of the same type and size
+ * @return null for fields that take any value, including items without a description
+ */
+const QValidator *QJsonModel::validator(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return nullptr;
+
+    return validator(static_cast<QJsonTreeItem*>(index.internalPointer()));
+}
+
+const QValidator *QJsonModel::validator(QJsonTreeItem *item) const
+{
+    // plain JSON values have no field type to check against
+    if (!item->hasRegisterInfo())
+        return nullptr;
+
+    const QJsonTreeItem::JsonFieldType type = item->fieldType();
+    if (type != QJsonTreeItem::STRING && type != QJsonTreeItem::INT && type != QJsonTreeItem::UINT)
+        return nullptr;
+
+    // strings are limited by length only, checked in acceptsValue()
+    const int size = type == QJsonTreeItem::STRING ? 0 : item->size();
+    const quint64 key = (quint64(type) << 32) | quint32(size);
+    QValidator *validator = mValidators.value(key);
+    if (!validator) {
+        QJsonModel *model = const_cast<QJsonModel*>(this);
+        if (type == QJsonTreeItem::STRING)
+            validator = new asciiValidator(model);
+        else if (type == QJsonTreeItem::INT)
+            validator = new rangeValidator(intMinLimit(size), quint64(intMaxLimit(size)), model);
+        else
+            validator = new rangeValidator(0, uintLimit(size), model);
+        mValidators.insert(key, validator);
+    }
+
+    return validator;
+}
+
+//!< Checks an edit of item against its edit mode, validator and size, items without a description take any value
+bool QJsonModel::acceptsValue(QJsonTreeItem *item, const QVariant &value) const
+{
+    if (!item->hasRegisterInfo())
+        return true;
+    if (item->editMode() == QJsonTreeItem::R)
+        return false;
+
+    const QValidator *validator = this->validator(item);
+    if (!validator)
+        return true;
+
+    QString str = value.toString();
+    int pos = 0;
+    if (validator->validate(str, pos) != QValidator::Acceptable)
+        return false;
+
+    return item->fieldType() != QJsonTreeItem::STRING || str.size() <= item->size();
+}
+
+//!< Stores an accepted edit, tracking it for takeDirtyRanges() and the search index
+void QJsonModel::applyValue(QJsonTreeItem *item, const QVariant &value)
+{
+    item->setValue(value);
+    if (item->isLeaf() && !item->isDirty()) {
+        item->setDirty(true);
+        mDirtyItems.append(item);
+    }
+    updateSearchEntry(item);
+}
+
+/**
+ * @brief QJsonModel::beginUpdate
+ * Starts a transaction: value changes from setData(), setValues(), replaceValue()
+ * and deserialize() are collected and reported by the matching endUpdate() with
+ * one dataChanged per run of adjacent rows under the same parent. Transactions
+ * nest, structural edits report the changes collected so far first.
+ */
+void QJsonModel::beginUpdate()
+{
+    ++mUpdateDepth;
+}
+
+void QJsonModel::endUpdate()
+{
+    if (mUpdateDepth > 0 && --mUpdateDepth == 0)
+        flushChanges();
+}
+
+bool QJsonModel::isUpdating() const
+{
+    return mUpdateDepth > 0;
+}
+
+//!< Reports the value changes collected by the current transaction
+void QJsonModel::flushChanges()
+{
+    if (mChangedItems.isEmpty())
+        return;
+
+    const QVector<QJsonTreeItem*> items = mChangedItems;
+    mChangedItems.clear();
+    emitChangedRuns(items, {Qt::DisplayRole, Qt::EditRole, Qt::UserRole});
+}
+
+/**
+ * @brief QJsonModel::setValues
+ * Validates all values first and applies them only if every one is accepted,
+ * views get one dataChanged per run of adjacent rows under the same parent.
+ */
+bool QJsonModel::setValues(const QVector<QPair<QModelIndex, QVariant>> &values)
+{
+    for (const QPair<QModelIndex, QVariant> &value : values) {
+        if (!value.first.isValid() || !acceptsValue(static_cast<QJsonTreeItem*>(value.first.internalPointer()), value.second))
+            return false;
+    }
+
+    QVector<QJsonTreeItem*> items;
+    items.reserve(values.size());
+    for (const QPair<QModelIndex, QVariant> &value : values) {
+        QJsonTreeItem *item = static_cast<QJsonTreeItem*>(value.first.internalPointer());
+        applyValue(item, value.second);
+        items.append(item);
+    }
+    if (mUpdateDepth > 0)
+        mChangedItems += items;
+    else
+        emitChangedRuns(items, {Qt::DisplayRole, Qt::EditRole, Qt::UserRole});
+
+    return true;
+}
+
+//!< Emits one dataChanged for each run of adjacent rows among items
+void QJsonModel::emitChangedRuns(QVector<QJsonTreeItem*> items, const QVector<int> &roles)
+{
+    std::sort(items.begin(), items.end(), [](QJsonTreeItem *a, QJsonTreeItem *b) {
+        return a->parent() != b->parent() ? a->parent() < b->parent() : a->row() < b->row();
+    });
+    items.erase(std::unique(items.begin(), items.end()), items.end());
+
+    for (int first = 0; first < items.size();) {
+        int last = first;
+        while (last + 1 < items.size() && items.at(last + 1)->parent() == items.at(first)->parent()
+               && items.at(last + 1)->row() == items.at(last)->row() + 1)
+            ++last;
+        QJsonTreeItem *from = items.at(first);
+        QJsonTreeItem *to = items.at(last);
+        emit dataChanged(createIndex(from->row(), 0, from), createIndex(to->row(), 1, to), roles);
+        first = last + 1;
     }
 }
 
@@ -910,41 +2517,14 @@ bool QJsonModel::setData(const QModelIndex &index, const QVariant &value, int ro
     if (Qt::EditRole == role) {
         if (col == 1) {
             QJsonTreeItem *item = static_cast<QJsonTreeItem*>(index.internalPointer());
-            if (item->editMode() == QJsonTreeItem::R)
+            if (!acceptsValue(item, value))
                 return false;
 
-            if (item->fieldType() == QJsonTreeItem::STRING) {
-                asciiValidator validator;
-                int pos;
-                auto str = value.toString();
-                auto state = validator.validate(str, pos);
-                if (state == QValidator::Invalid)
-                    return false;
-                if (str.size() > item->size())
-                    return false;
-            } else if (item->fieldType() == QJsonTreeItem::INT) {
-                QIntValidator validator;
-                int max = intMaxLimit(item->size());
-                int min = intMinLimit(item->size());
-                validator.setRange(min, max);
-                int pos = 0;
-                auto str = value.toString();
-                auto state = validator.validate(str, pos);
-                if (state == QValidator::Invalid || state == QValidator::Intermediate)
-                    return false;
-            } else if (item->fieldType() == QJsonTreeItem::UINT) {
-                QIntValidator validator;
-                int max = uintLimit(item->size());
-                validator.setRange(0, max);
-                int pos = 0;
-                auto str = value.toString();
-                auto state = validator.validate(str, pos);
-                if (state == QValidator::Invalid || state == QValidator::Intermediate)
-                    return false;
-            }
-
-            item->setValue(value);
-            emit dataChanged(index, index, {Qt::EditRole});
+            applyValue(item, value);
+            if (mUpdateDepth > 0)
+                mChangedItems.append(item);
+            else
+                emit dataChanged(index, index, {Qt::DisplayRole, Qt::EditRole, Qt::UserRole});
             return true;
         }
     }
@@ -1010,6 +2590,51 @@ int QJsonModel::rowCount(const QModelIndex &parent) const
     return parentItem->childCount();
 }
 
+bool QJsonModel::hasChildren(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return false;
+
+    QJsonTreeItem *parentItem = parent.isValid() ? static_cast<QJsonTreeItem*>(parent.internalPointer()) : mRootItem;
+    if (!parentItem)
+        return false;
+
+    if (parentItem->isPending())
+        return parentItem->hasPendingChildren();
+
+    return parentItem->childCount() > 0;
+}
+
+bool QJsonModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (!parent.isValid() || parent.column() > 0)
+        return false;
+
+    return static_cast<QJsonTreeItem*>(parent.internalPointer())->isPending();
+}
+
+/**
+ * @brief QJsonModel::fetchMore
+ * Creates the children of a pending container, their own containers stay pending
+ */
+void QJsonModel::fetchMore(const QModelIndex &parent)
+{
+    if (!canFetchMore(parent))
+        return;
+
+    QJsonTreeItem *parentItem = static_cast<QJsonTreeItem*>(parent.internalPointer());
+    const QList<QJsonTreeItem*> childs = parentItem->takePendingChildren(mExceptions, editArena());
+    if (childs.isEmpty())
+        return;
+
+    beginInsertRows(parent, 0, childs.count() - 1);
+    for (QJsonTreeItem *child : childs) {
+        parentItem->appendChild(child);
+        addSearchEntries(child);
+    }
+    endInsertRows();
+}
+
 int QJsonModel::columnCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent)
@@ -1031,129 +2656,1063 @@ Qt::ItemFlags QJsonModel::flags(const QModelIndex &index) const
     }
 }
 
-QByteArray QJsonModel::json()
+//!< Splits an RFC 6901 pointer into unescaped reference tokens
+static bool pointerTokens(const QString &pointer, QStringList &tokens)
 {
-    auto jsonValue = genJson(mRootItem);
-    QByteArray json;
-    if (jsonValue.isNull()) {
-        return json;
-    }
-    if (jsonValue.isArray()) {
-        arrayToJson(jsonValue.toArray(), json, 0, false);
-    } else {
-        objectToJson(jsonValue.toObject(), json, 0, false);
+    tokens.clear();
+    if (pointer.isEmpty())
+        return true;
+    if (!pointer.startsWith('/'))
+        return false;
+
+    tokens = pointer.mid(1).split('/');
+    for (QString &token : tokens) {
+        if (token.contains('~'))
+            token.replace(QLatin1String("~1"), QLatin1String("/")).replace(QLatin1String("~0"), QLatin1String("~"));
     }
-    return json;
-}
 
-void QJsonModel::objectToJson(QJsonObject jsonObject, QByteArray &json, int indent, bool compact)
-{
-    json += compact ? "{" : "{\n";
-    objectContentToJson(jsonObject, json, indent + (compact ? 0 : 1), compact);
-    json += QByteArray(4 * indent, ' ');
-    json += compact ? "}" : "}\n";
+    return true;
 }
 
-void QJsonModel::arrayToJson(QJsonArray jsonArray, QByteArray &json, int indent, bool compact)
+//!< Escapes a key for use as an RFC 6901 reference token
+static QString pointerToken(const QString &key)
 {
-    json += compact ? "[" : "[\n";
-    arrayContentToJson(jsonArray, json, indent + (compact ? 0 : 1), compact);
-    json += QByteArray(4 * indent, ' ');
-    json += compact ? "]" : "]\n";
-}
+    if (!key.contains('~') && !key.contains('/'))
+        return key;
 
-void QJsonModel::arrayContentToJson(QJsonArray jsonArray, QByteArray &json, int indent, bool compact)
-{
-    if (jsonArray.size() <= 0) {
-        return;
-    }
-    QByteArray indentString(4 * indent, ' ');
-    int i = 0;
-    while (1) {
-        json += indentString;
-        valueToJson(jsonArray.at(i), json, indent, compact);
-        if (++i == jsonArray.size()) {
-            if (!compact)
-                json += '\n';
-            break;
-        }
-        json += compact ? "," : ",\n";
-    }
+    QString token = key;
+    return token.replace(QLatin1String("~"), QLatin1String("~0")).replace(QLatin1String("/"), QLatin1String("~1"));
 }
 
-void QJsonModel::objectContentToJson(QJsonObject jsonObject, QByteArray &json, int indent, bool compact)
+//!< Position of the first member of the object item whose key is not less than key
+static int keyLowerBound(QJsonTreeItem *item, const QString &key)
 {
-    if (jsonObject.size() <= 0) {
-        return;
-    }
-    QByteArray indentString(4 * indent, ' ');
-    int i = 0;
-    while (1) {
-        QString key = jsonObject.keys().at(i);
-        json += indentString;
-        json += '"';
-        json += escapedString(key);
-        json += compact ? "\":" : "\": ";
-        valueToJson(jsonObject.value(key), json, indent, compact);
-        if (++i == jsonObject.size()) {
-            if (!compact)
-                json += '\n';
-            break;
+    int row = 0;
+    int count = item->childCount();
+    while (count > 0) {
+        const int step = count / 2;
+        if (item->child(row + step)->key() < key) {
+            row += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
         }
-        json += compact ? "," : ",\n";
     }
+
+    return row;
 }
 
-void QJsonModel::valueToJson(QJsonValue jsonValue, QByteArray &json, int indent, bool compact)
+/**
+ * @brief QJsonModel::childRow
+ * Row of the child named by a pointer token, -1 if there is none. Members of
+ * large objects are found through a key hash built on first use.
+ */
+int QJsonModel::childRow(QJsonTreeItem *item, const QString &token) const
 {
-    QJsonValue::Type type = jsonValue.type();
-    switch (type) {
-    case QJsonValue::Bool:
-        json += jsonValue.toBool() ? "true" : "false";
-        break;
-    case QJsonValue::Double: {
-        const double d = jsonValue.toDouble();
-        if (qIsFinite(d)) {
-            json += QByteArray::number(d, 'f', QLocale::FloatingPointShortest);
-        } else {
-            json += "null"; // +INF || -INF || NaN (see RFC4627#section2.4)
+    if (item->type() == QJsonValue::Object) {
+        const int count = item->childCount();
+        if (count < KeyIndexThreshold) {
+            for (int i = 0; i < count; ++i)
+                if (item->child(i)->key() == token)
+                    return i;
+            return -1;
         }
-        break;
-    }
-    case QJsonValue::String: {
-        json += '"';
-        QString str;
-        if (QDate::fromString(jsonValue.toString(), Qt::ISODate).isValid()) {
-            str = jsonValue.toString();
-            str = QDate::fromString(str, Qt::ISODate).toString("dd.MM.yyyy");
-        } else {
-            str = jsonValue.toString();
+
+        auto keys = mKeyIndex.find(item);
+        if (keys == mKeyIndex.end()) {
+            QHash<QString, QJsonTreeItem*> hash;
+            hash.reserve(count);
+            for (int i = 0; i < count; ++i)
+                hash.insert(item->child(i)->key(), item->child(i));
+            keys = mKeyIndex.insert(item, hash);
         }
-        json += escapedString(str);
-        json += '"';
-        break;
+        QJsonTreeItem *child = keys->value(token);
+        return child ? child->row() : -1;
     }
-    case QJsonValue::Array:
-        json += compact ? "[" : "[\n";
-        arrayContentToJson(jsonValue.toArray(), json, indent + (compact ? 0 : 1), compact);
-        json += QByteArray(4 * indent, ' ');
-        json += ']';
-        break;
-    case QJsonValue::Object:
-        json += compact ? "{" : "{\n";
-        objectContentToJson(jsonValue.toObject(), json, indent + (compact ? 0 : 1), compact);
-        json += QByteArray(4 * indent, ' ');
-        json += '}';
-        break;
-    case QJsonValue::Null:
-    default:
-        json += "null";
+    if (item->type() == QJsonValue::Array) {
+        // array indices are plain decimals without sign or leading zeros
+        if (token.isEmpty() || (token.size() > 1 && token.at(0) == '0'))
+            return -1;
+        for (const QChar c : token)
+            if (!c.isDigit())
+                return -1;
+        bool ok;
+        const int row = token.toInt(&ok);
+        return ok && row < item->childCount() ? row : -1;
     }
+
+    return -1;
 }
 
-void QJsonModel::addException(const QStringList &exceptions)
+//!< Members of an added object are merged into nothing, which drops null members
+static QJsonValue withoutNulls(const QJsonValue &value)
 {
-    mExceptions = exceptions;
+    if (!value.isObject())
+        return value;
+
+    QJsonObject obj;
+    const QJsonObject source = value.toObject();
+    for (auto it = source.constBegin(); it != source.constEnd(); ++it)
+        if (!it.value().isNull())
+            obj.insert(it.key(), withoutNulls(it.value()));
+
+    return obj;
+}
+
+/**
+ * @brief QJsonModel::insertKey
+ * Adds a member to the object at parent, keeping the members ordered by key
+ * @return index of the new item, invalid if parent is not an object or already has key
+ */
+QModelIndex QJsonModel::insertKey(const QModelIndex &parent, const QString &key, const QJsonValue &value)
+{
+    flushChanges();
+    const QModelIndex parentIndex = parent.sibling(parent.row(), 0);
+    QJsonTreeItem *parentItem = itemFromIndex(parentIndex);
+    if (!parentItem || parentItem->type() != QJsonValue::Object)
+        return QModelIndex();
+    fetchMore(parentIndex);
+
+    const int row = keyLowerBound(parentItem, key);
+    if (row < parentItem->childCount() && parentItem->child(row)->key() == key) {
+        qDebug()<<Q_FUNC_INFO<<"key already exists:"<<key;
+        return QModelIndex();
+    }
+
+    beginInsertRows(parentIndex, row, row);
+    QJsonTreeItem *item = createItem(key, value);
+    parentItem->insertChild(row, item);
+    auto keys = mKeyIndex.find(parentItem);
+    if (keys != mKeyIndex.end())
+        keys->insert(key, item);
+    addSearchEntries(item);
+    if (mPatchJournal)
+        mPatchJournal->append(PatchStep(PatchStep::Inserted, parentItem, row));
+    invalidatePlan();
+    endInsertRows();
+
+    return index(row, 0, parentIndex);
+}
+
+/**
+ * @brief QJsonModel::insertElement
+ * Inserts value into the array at parent before row, the keys of the following
+ * elements follow their new rows without being rewritten
+ * @return index of the new item, invalid if parent is not an array
+ */
+QModelIndex QJsonModel::insertElement(const QModelIndex &parent, int row, const QJsonValue &value)
+{
+    flushChanges();
+    const QModelIndex parentIndex = parent.sibling(parent.row(), 0);
+    QJsonTreeItem *parentItem = itemFromIndex(parentIndex);
+    if (!parentItem || parentItem->type() != QJsonValue::Array)
+        return QModelIndex();
+    fetchMore(parentIndex);
+
+    row = qBound(0, row, parentItem->childCount());
+    beginInsertRows(parentIndex, row, row);
+    QJsonTreeItem *item = createItem(QString(), value);
+    parentItem->insertChild(row, item);
+    addSearchEntries(item);
+    if (mPatchJournal)
+        mPatchJournal->append(PatchStep(PatchStep::Inserted, parentItem, row));
+    invalidatePlan();
+    endInsertRows();
+
+    return index(row, 0, parentIndex);
+}
+
+bool QJsonModel::removeRows(int row, int count, const QModelIndex &parent)
+{
+    flushChanges();
+    const QModelIndex parentIndex = parent.sibling(parent.row(), 0);
+    QJsonTreeItem *parentItem = itemFromIndex(parentIndex);
+    if (!parentItem || row < 0 || count <= 0 || row + count > parentItem->childCount())
+        return false;
+
+    beginRemoveRows(parentIndex, row, row + count - 1);
+    const QList<QJsonTreeItem*> removed = parentItem->takeChildren(row, count);
+    // deleteItem() edits mKeyIndex as well, so keys are dropped before any item is deleted
+    auto keys = mKeyIndex.find(parentItem);
+    if (keys != mKeyIndex.end()) {
+        for (QJsonTreeItem *item : removed)
+            keys->remove(item->key());
+    }
+    if (mPatchJournal) {
+        // kept for rollbackPatch(), only the search must not find them anymore
+        for (QJsonTreeItem *item : removed)
+            removeSearchEntries(item);
+        PatchStep step(PatchStep::Removed, parentItem, row);
+        step.items = removed;
+        mPatchJournal->append(step);
+    } else {
+        for (QJsonTreeItem *item : removed)
+            deleteItem(item);
+    }
+    invalidatePlan();
+    endRemoveRows();
+
+    return true;
+}
+
+/**
+ * @brief QJsonModel::moveRows
+ * Reorders elements of an array. Object members are ordered by key and
+ * items are not moved between parents, both are refused.
+ */
+bool QJsonModel::moveRows(const QModelIndex &sourceParent, int sourceRow, int count,
+                          const QModelIndex &destinationParent, int destinationChild)
+{
+    flushChanges();
+    const QModelIndex parentIndex = sourceParent.sibling(sourceParent.row(), 0);
+    QJsonTreeItem *parentItem = itemFromIndex(parentIndex);
+    if (!parentItem || parentItem != itemFromIndex(destinationParent) || parentItem->type() != QJsonValue::Array)
+        return false;
+    if (sourceRow < 0 || count <= 0 || sourceRow + count > parentItem->childCount()
+            || destinationChild < 0 || destinationChild > parentItem->childCount())
+        return false;
+    if (!beginMoveRows(parentIndex, sourceRow, sourceRow + count - 1, parentIndex, destinationChild))
+        return false;
+
+    if (destinationChild > sourceRow) {
+        for (int i = 0; i < count; ++i)
+            parentItem->moveChild(sourceRow, destinationChild - 1);
+    } else {
+        for (int i = 0; i < count; ++i)
+            parentItem->moveChild(sourceRow + i, destinationChild + i);
+    }
+    invalidatePlan();
+    endMoveRows();
+
+    return true;
+}
+
+/**
+ * @brief QJsonModel::replaceValue
+ * Replaces the value or the whole subtree of the item at index, the item itself
+ * keeps its key and position. An invalid index replaces the document, which
+ * must stay an object or an array. Described fields cannot become containers
+ * and take only values their edit mode, type and size accept.
+ */
+bool QJsonModel::replaceValue(const QModelIndex &index, const QJsonValue &value)
+{
+    flushChanges();
+    const QModelIndex itemIndex = index.sibling(index.row(), 0);
+    QJsonTreeItem *item = itemFromIndex(itemIndex);
+    const bool isContainer = value.isObject() || value.isArray();
+    if (!item || (!itemIndex.isValid() && !isContainer) || (isContainer && item->isLeaf()))
+        return false;
+    // scalars go through the same checks as setData()
+    if (!isContainer && !acceptsValue(item, value.toVariant()))
+        return false;
+
+    PatchStep step(PatchStep::Replaced, item);
+    if (mPatchJournal) {
+        step.value = item->value();
+        step.pending = item->pendingValue();
+        step.type = item->type();
+        step.isPending = item->isPending();
+        step.isDirty = item->isDirty();
+    }
+    if (item->childCount() > 0) {
+        beginRemoveRows(itemIndex, 0, item->childCount() - 1);
+        const QList<QJsonTreeItem*> childs = item->takeChildren(0, item->childCount());
+        for (QJsonTreeItem *child : childs) {
+            if (mPatchJournal)
+                removeSearchEntries(child);
+            else
+                deleteItem(child);
+        }
+        if (mPatchJournal)
+            step.items = childs;
+        mKeyIndex.remove(item);
+        invalidatePlan();
+        endRemoveRows();
+    }
+    if (mPatchJournal)
+        mPatchJournal->append(step);
+    item->takePending();
+    item->setType(value.type());
+
+    if (isContainer) {
+        item->setValue(QVariant());
+        updateSearchEntry(item);
+        QJsonTreeItem *source = createItem(item->key(), value);
+        const QList<QJsonTreeItem*> childs = source->isPending()
+                ? source->takePendingChildren(mExceptions, editArena())
+                : source->takeChildren(0, source->childCount());
+        deleteItem(source);
+        if (!childs.isEmpty()) {
+            beginInsertRows(itemIndex, 0, childs.count() - 1);
+            for (QJsonTreeItem *child : childs) {
+                item->appendChild(child);
+                addSearchEntries(child);
+            }
+            invalidatePlan();
+            endInsertRows();
+        }
+    } else {
+        applyValue(item, value.toVariant());
+    }
+    if (itemIndex.isValid()) {
+        if (!isContainer && mUpdateDepth > 0)
+            mChangedItems.append(item);
+        else
+            emit dataChanged(itemIndex, itemIndex.sibling(itemIndex.row(), 1), {Qt::DisplayRole, Qt::EditRole, Qt::UserRole});
+    }
+
+    return true;
+}
+
+/**
+ * @brief QJsonModel::indexFromPointer
+ * Resolves an RFC 6901 JSON Pointer such as "/devices/0/name". Pending
+ * containers on the path are expanded.
+ * @return index of the item, invalid if there is none or for the document itself ("")
+ */
+QModelIndex QJsonModel::indexFromPointer(const QString &pointer)
+{
+    QModelIndex index;
+    return resolvePointer(pointer, index) ? index : QModelIndex();
+}
+
+/**
+ * @brief QJsonModel::indexFromPath
+ * Resolves a dotted path such as "devices.0.name", keys holding dots need indexFromPointer()
+ */
+QModelIndex QJsonModel::indexFromPath(const QString &path)
+{
+    QModelIndex index;
+    const QStringList tokens = path.isEmpty() ? QStringList() : path.split('.');
+    return resolveTokens(tokens, index) ? index : QModelIndex();
+}
+
+//! JSON Pointer of the item at index, "" for the document itself
+QString QJsonModel::pointer(const QModelIndex &index) const
+{
+    QStringList tokens;
+    for (QJsonTreeItem *item = itemFromIndex(index); item && item != mRootItem; item = item->parent())
+        tokens.prepend(pointerToken(item->key()));
+
+    return tokens.isEmpty() ? QString() : '/' + tokens.join('/');
+}
+
+/**
+ * @brief QJsonModel::applyJsonPatch
+ * Applies an RFC 6902 patch to the tree through the structural edits, so views
+ * only see the rows that change. Operations are applied in order. The edits
+ * record their inverse in a journal, and if an operation fails the ones before
+ * it are undone, so the tree is left as it was.
+ */
+bool QJsonModel::applyJsonPatch(const QJsonArray &patch)
+{
+    QVector<PatchStep> journal;
+    mPatchJournal = &journal;
+    bool ok = true;
+    for (const QJsonValue &entry : patch) {
+        const QJsonObject operation = entry.toObject();
+        const QString op = operation.value("op").toString();
+        const QString path = operation.value("path").toString();
+        const QString from = operation.value("from").toString();
+        const QJsonValue value = operation.value("value");
+        ok = false;
+        if (!operation.contains("path")) {
+            qDebug()<<Q_FUNC_INFO<<"operation without a path";
+        } else if (op == "add") {
+            ok = operation.contains("value") && patchAdd(path, value);
+        } else if (op == "remove") {
+            ok = patchRemove(path);
+        } else if (op == "replace") {
+            QModelIndex index;
+            ok = operation.contains("value") && resolvePointer(path, index) && replaceValue(index, value);
+        } else if (op == "move") {
+            QModelIndex index;
+            // a value cannot be moved into one of its own children
+            ok = operation.contains("from") && !path.startsWith(from + '/') && resolvePointer(from, index);
+            if (ok && from != path) {
+                const QJsonValue moved = itemFromIndex(index)->toJsonValue(mExceptions);
+                ok = patchRemove(from) && patchAdd(path, moved);
+            }
+        } else if (op == "copy") {
+            QModelIndex index;
+            ok = operation.contains("from") && resolvePointer(from, index)
+                    && patchAdd(path, itemFromIndex(index)->toJsonValue(mExceptions));
+        } else if (op == "test") {
+            QModelIndex index;
+            ok = resolvePointer(path, index) && itemFromIndex(index)->toJsonValue(mExceptions) == value;
+        }
+
+        if (!ok) {
+            qDebug()<<Q_FUNC_INFO<<"cannot apply"<<op<<path;
+            break;
+        }
+    }
+    mPatchJournal = nullptr;
+
+    if (ok)
+        commitPatch(journal);
+    else
+        rollbackPatch(journal);
+
+    return ok;
+}
+
+//!< Undoes the journaled edits of a failed patch, last edit first
+void QJsonModel::rollbackPatch(const QVector<PatchStep> &journal)
+{
+    flushChanges();
+    for (int i = journal.size() - 1; i >= 0; --i) {
+        const PatchStep &step = journal.at(i);
+        // parent of the rows, the item itself for Replaced
+        const QModelIndex itemIndex = indexOfItem(step.item);
+        if (step.kind == PatchStep::Inserted) {
+            removeRows(step.row, 1, itemIndex);
+        } else if (step.kind == PatchStep::Removed) {
+            beginInsertRows(itemIndex, step.row, step.row + step.items.count() - 1);
+            auto keys = mKeyIndex.find(step.item);
+            for (int j = 0; j < step.items.count(); ++j) {
+                QJsonTreeItem *item = step.items.at(j);
+                step.item->insertChild(step.row + j, item);
+                if (keys != mKeyIndex.end())
+                    keys->insert(item->key(), item);
+                addSearchEntries(item);
+            }
+            invalidatePlan();
+            endInsertRows();
+        } else {
+            QJsonTreeItem *item = step.item;
+            if (item->childCount() > 0) {
+                beginRemoveRows(itemIndex, 0, item->childCount() - 1);
+                for (QJsonTreeItem *child : item->takeChildren(0, item->childCount()))
+                    deleteItem(child);
+                mKeyIndex.remove(item);
+                invalidatePlan();
+                endRemoveRows();
+            }
+            item->setType(step.type);
+            if (step.isPending)
+                item->setPending(step.pending);
+            else
+                item->setValue(step.value);
+            if (item->isDirty() && !step.isDirty) {
+                item->setDirty(false);
+                mDirtyItems.removeOne(item);
+            }
+            updateSearchEntry(item);
+            if (!step.items.isEmpty()) {
+                beginInsertRows(itemIndex, 0, step.items.count() - 1);
+                for (QJsonTreeItem *child : step.items) {
+                    item->appendChild(child);
+                    addSearchEntries(child);
+                }
+                invalidatePlan();
+                endInsertRows();
+            }
+            if (itemIndex.isValid())
+                emit dataChanged(itemIndex, itemIndex.sibling(itemIndex.row(), 1),
+                                 {Qt::DisplayRole, Qt::EditRole, Qt::UserRole});
+        }
+    }
+}
+
+//!< Releases the items a successful patch removed or replaced
+void QJsonModel::commitPatch(const QVector<PatchStep> &journal)
+{
+    for (const PatchStep &step : journal)
+        for (QJsonTreeItem *item : step.items)
+            deleteItem(item);
+}
+
+//!< Index of the key column of item, invalid for the root
+QModelIndex QJsonModel::indexOfItem(QJsonTreeItem *item) const
+{
+    return item && item != mRootItem ? createIndex(item->row(), 0, item) : QModelIndex();
+}
+
+/**
+ * @brief QJsonModel::applyMergePatch
+ * Applies an RFC 7386 merge patch to the document: null members are removed,
+ * objects are merged recursively and any other value replaces the target.
+ */
+bool QJsonModel::applyMergePatch(const QJsonValue &patch)
+{
+    return mRootItem && mergePatch(QModelIndex(), patch);
+}
+
+//!< Resolves an RFC 6901 pointer, the document itself is the invalid index
+bool QJsonModel::resolvePointer(const QString &pointer, QModelIndex &index)
+{
+    QStringList tokens;
+    return pointerTokens(pointer, tokens) && resolveTokens(tokens, index);
+}
+
+//!< Follows unescaped reference tokens from the document, expanding pending containers on the way
+bool QJsonModel::resolveTokens(const QStringList &tokens, QModelIndex &index)
+{
+    if (!mRootItem)
+        return false;
+
+    index = QModelIndex();
+    for (const QString &token : tokens) {
+        fetchMore(index);
+        const int row = childRow(itemFromIndex(index), token);
+        if (row < 0)
+            return false;
+        index = this->index(row, 0, index);
+    }
+
+    return true;
+}
+
+bool QJsonModel::patchAdd(const QString &path, const QJsonValue &value)
+{
+    QStringList tokens;
+    if (!mRootItem || !pointerTokens(path, tokens))
+        return false;
+    if (tokens.isEmpty())
+        return replaceValue(QModelIndex(), value);
+
+    const QString key = tokens.takeLast();
+    QModelIndex parent;
+    if (!resolveTokens(tokens, parent))
+        return false;
+    fetchMore(parent);
+
+    QJsonTreeItem *parentItem = itemFromIndex(parent);
+    if (parentItem->type() == QJsonValue::Object) {
+        const int row = childRow(parentItem, key);
+        if (row >= 0)
+            return replaceValue(index(row, 0, parent), value);
+        return insertKey(parent, key, value).isValid();
+    }
+    if (parentItem->type() == QJsonValue::Array) {
+        const int row = key == "-" ? parentItem->childCount() : childRow(parentItem, key);
+        // appending through the index one past the end is allowed as well
+        if (row < 0 && key != QString::number(parentItem->childCount()))
+            return false;
+        return insertElement(parent, row < 0 ? parentItem->childCount() : row, value).isValid();
+    }
+
+    return false;
+}
+
+bool QJsonModel::patchRemove(const QString &path)
+{
+    QModelIndex index;
+    if (!resolvePointer(path, index) || !index.isValid())
+        return false;
+
+    return removeRows(index.row(), 1, index.parent());
+}
+
+bool QJsonModel::mergePatch(const QModelIndex &target, const QJsonValue &patch)
+{
+    if (!patch.isObject())
+        return replaceValue(target, patch);
+
+    QJsonTreeItem *item = itemFromIndex(target);
+    if (item->type() != QJsonValue::Object && !replaceValue(target, QJsonObject()))
+        return false;
+    fetchMore(target);
+
+    const QJsonObject obj = patch.toObject();
+    for (auto it = obj.constBegin(); it != obj.constEnd(); ++it) {
+        if (contains(mExceptions, it.key()))
+            continue;
+        const int row = childRow(item, it.key());
+        bool ok = true;
+        if (it.value().isNull()) {
+            if (row >= 0)
+                ok = removeRows(row, 1, target);
+        } else if (row >= 0) {
+            ok = mergePatch(index(row, 0, target), it.value());
+        } else {
+            ok = insertKey(target, it.key(), withoutNulls(it.value())).isValid();
+        }
+        if (!ok)
+            return false;
+    }
+
+    return true;
+}
+
+//!< Cheap pre-check of the yyyy-MM-dd shape, so that QDate parsing runs only on likely dates
+static inline bool looksLikeIsoDate(const QString &value)
+{
+    return value.size() >= 10 && value.at(4) == QLatin1Char('-') && value.at(7) == QLatin1Char('-');
+}
+
+//!< Writes a quoted JSON string, with detectDate ISO dates are rewritten as dd.MM.yyyy
+static void stringToJson(const QString &value, QByteArray &json, bool detectDate)
+{
+    json += '"';
+    QDate date;
+    if (detectDate && looksLikeIsoDate(value))
+        date = QDate::fromString(value, Qt::ISODate);
+    if (date.isValid())
+        json += escapedString(date.toString("dd.MM.yyyy"));
+    else
+        json += escapedString(value);
+    json += '"';
+}
+
+//!< Writes the value of a DATE field as dd.MM.yyyy
+static void dateToJson(const QVariant &value, QByteArray &json)
+{
+    if (value.type() == QVariant::Date) {
+        json += '"';
+        json += value.toDate().toString("dd.MM.yyyy").toLatin1();
+        json += '"';
+    } else {
+        stringToJson(value.toString(), json, true);
+    }
+}
+
+/**
+ * @brief The JsonTreeWriter class
+ * Writes a QJsonTreeItem tree as JSON text directly, without building an
+ * intermediate QJsonValue. With a device the output is flushed in chunks,
+ * so memory use is bounded by the chunk size.
+ */
+class JsonTreeWriter
+{
+public:
+    JsonTreeWriter(QByteArray &buffer, QIODevice *device, bool compact, QJsonModel::DateExport dates,
+                   const QStringList &exceptions)
+        : mJson(buffer)
+        , mDevice(device)
+        , mCompact(compact)
+        , mDates(dates)
+        , mExceptions(exceptions)
+    {
+        if (mDevice)
+            mJson.reserve(ChunkSize * 2);
+    }
+
+    bool write(QJsonTreeItem *root)
+    {
+        const bool isArray = QJsonValue::Array == root->type();
+        mJson += isArray ? '[' : '{';
+        if (!mCompact)
+            mJson += '\n';
+        writeContent(root, mCompact ? 0 : 1);
+        mJson += isArray ? ']' : '}';
+        if (!mCompact)
+            mJson += '\n';
+        flush();
+
+        return mOk;
+    }
+
+private:
+    enum { ChunkSize = 64 * 1024 };
+
+    void writeContent(QJsonTreeItem *item, int indent)
+    {
+        const bool isObject = QJsonValue::Object == item->type();
+        const int nchild = item->childCount();
+        for (int i = 0; i < nchild && mOk; ++i) {
+            QJsonTreeItem *ch = item->child(i);
+            mJson.append(4 * indent, ' ');
+            if (isObject) {
+                mJson += '"';
+                mJson += escapedString(ch->key());
+                mJson += mCompact ? "\":" : "\": ";
+            }
+            writeValue(ch, indent);
+            if (i + 1 < nchild)
+                mJson += ',';
+            if (!mCompact)
+                mJson += '\n';
+            if (mDevice && mJson.size() >= ChunkSize)
+                flush();
+        }
+    }
+
+    void writeValue(QJsonTreeItem *item, int indent)
+    {
+        switch (item->type()) {
+        case QJsonValue::Object:
+        case QJsonValue::Array: {
+            const bool isArray = QJsonValue::Array == item->type();
+            mJson += isArray ? '[' : '{';
+            if (!mCompact)
+                mJson += '\n';
+            // containers that were not expanded yet are written from their source
+            if (item->isPending())
+                writeContent(item->pendingValue(), indent + (mCompact ? 0 : 1));
+            else
+                writeContent(item, indent + (mCompact ? 0 : 1));
+            mJson.append(4 * indent, ' ');
+            mJson += isArray ? ']' : '}';
+            break;
+        }
+        default:
+            writeScalar(item->value(), item->fieldType() == QJsonTreeItem::DATE);
+        }
+    }
+
+    //!< Same output as for the items QJsonTreeItem::load() would create from value
+    void writeContent(const QJsonValue &value, int indent)
+    {
+        if (value.isObject()) {
+            const QJsonObject obj = value.toObject();
+            bool first = true;
+            for (auto it = obj.constBegin(); it != obj.constEnd() && mOk; ++it) {
+                if (contains(mExceptions, it.key()))
+                    continue;
+                if (!first) {
+                    mJson += ',';
+                    if (!mCompact)
+                        mJson += '\n';
+                }
+                first = false;
+                mJson.append(4 * indent, ' ');
+                mJson += '"';
+                mJson += escapedString(it.key());
+                mJson += mCompact ? "\":" : "\": ";
+                writeValue(it.value(), indent);
+                if (mDevice && mJson.size() >= ChunkSize)
+                    flush();
+            }
+            if (!first && !mCompact)
+                mJson += '\n';
+        } else {
+            const QJsonArray arr = value.toArray();
+            for (int i = 0; i < arr.size() && mOk; ++i) {
+                mJson.append(4 * indent, ' ');
+                writeValue(arr.at(i), indent);
+                if (i + 1 < arr.size())
+                    mJson += ',';
+                if (!mCompact)
+                    mJson += '\n';
+                if (mDevice && mJson.size() >= ChunkSize)
+                    flush();
+            }
+        }
+    }
+
+    void writeValue(const QJsonValue &value, int indent)
+    {
+        if (value.isObject() || value.isArray()) {
+            const bool isArray = value.isArray();
+            mJson += isArray ? '[' : '{';
+            if (!mCompact)
+                mJson += '\n';
+            writeContent(value, indent + (mCompact ? 0 : 1));
+            mJson.append(4 * indent, ' ');
+            mJson += isArray ? ']' : '}';
+        } else {
+            writeScalar(value.toVariant(), false);
+        }
+    }
+
+    void writeScalar(const QVariant &value, bool isDate)
+    {
+        if (value.type() == QVariant::Bool)
+            mJson += value.toBool() ? "true" : "false";
+        else if (mDates == QJsonModel::RawStrings)
+            stringToJson(value.toString(), mJson, false);
+        else if (isDate)
+            dateToJson(value, mJson);
+        else
+            stringToJson(value.toString(), mJson, mDates == QJsonModel::DetectDates);
+    }
+
+    void flush()
+    {
+        if (!mDevice || !mOk || mJson.isEmpty())
+            return;
+        mOk = mDevice->write(mJson) == mJson.size();
+        mJson.resize(0);
+    }
+
+    QByteArray &mJson;
+    QIODevice *mDevice;
+    bool mCompact;
+    QJsonModel::DateExport mDates;
+    const QStringList &mExceptions;
+    bool mOk = true;
+};
+
+QByteArray QJsonModel::json(bool compact) const
+{
+    QByteArray json;
+    writeJson(json, compact);
+    return json;
+}
+
+/**
+ * @brief QJsonModel::writeJson
+ * Appends the JSON text of the tree to a caller provided buffer
+ */
+void QJsonModel::writeJson(QByteArray &buffer, bool compact) const
+{
+    JsonTreeWriter writer(buffer, nullptr, compact, mDateExport, mExceptions);
+    writer.write(mRootItem);
+}
+
+/**
+ * @brief QJsonModel::writeJson
+ * Streams the JSON text of the tree to the device in chunks of 64 KiB
+ * @return false if writing to the device failed
+ */
+bool QJsonModel::writeJson(QIODevice *device, bool compact) const
+{
+    QByteArray buffer;
+    JsonTreeWriter writer(buffer, device, compact, mDateExport, mExceptions);
+    return writer.write(mRootItem);
+}
+
+int QJsonModel::countItems(QJsonTreeItem *item)
+{
+    int count = 1;
+    int nchild = item->childCount();
+    for (int i = 0; i < nchild; ++i)
+        count += countItems(item->child(i));
+
+    return count;
+}
+
+void QJsonModel::objectToJson(const QJsonObject &jsonObject, QByteArray &json, int indent, bool compact)
+{
+    json += compact ? "{" : "{\n";
+    objectContentToJson(jsonObject, json, indent + (compact ? 0 : 1), compact);
+    json.append(4 * indent, ' ');
+    json += compact ? "}" : "}\n";
+}
+
+void QJsonModel::arrayToJson(const QJsonArray &jsonArray, QByteArray &json, int indent, bool compact)
+{
+    json += compact ? "[" : "[\n";
+    arrayContentToJson(jsonArray, json, indent + (compact ? 0 : 1), compact);
+    json.append(4 * indent, ' ');
+    json += compact ? "]" : "]\n";
+}
+
+void QJsonModel::arrayContentToJson(const QJsonArray &jsonArray, QByteArray &json, int indent, bool compact)
+{
+    if (jsonArray.size() <= 0) {
+        return;
+    }
+    QByteArray indentString(4 * indent, ' ');
+    auto it = jsonArray.constBegin();
+    while (1) {
+        json += indentString;
+        valueToJson(*it, json, indent, compact);
+        if (++it == jsonArray.constEnd()) {
+            if (!compact)
+                json += '\n';
+            break;
+        }
+        json += compact ? "," : ",\n";
+    }
+}
+
+void QJsonModel::objectContentToJson(const QJsonObject &jsonObject, QByteArray &json, int indent, bool compact)
+{
+    if (jsonObject.size() <= 0) {
+        return;
+    }
+    QByteArray indentString(4 * indent, ' ');
+    // Single pass in key order, keys() would rebuild the key list per member
+    auto it = jsonObject.constBegin();
+    while (1) {
+        json += indentString;
+        json += '"';
+        json += escapedString(it.key());
+        json += compact ? "\":" : "\": ";
+        valueToJson(it.value(), json, indent, compact);
+        if (++it == jsonObject.constEnd()) {
+            if (!compact)
+                json += '\n';
+            break;
+        }
+        json += compact ? "," : ",\n";
+    }
+}
+
+void QJsonModel::valueToJson(const QJsonValue &jsonValue, QByteArray &json, int indent, bool compact)
+{
+    QJsonValue::Type type = jsonValue.type();
+    switch (type) {
+    case QJsonValue::Bool:
+        json += jsonValue.toBool() ? "true" : "false";
+        break;
+    case QJsonValue::Double: {
+        const double d = jsonValue.toDouble();
+        if (qIsFinite(d)) {
+            json += QByteArray::number(d, 'f', QLocale::FloatingPointShortest);
+        } else {
+            json += "null"; // +INF || -INF || NaN (see RFC4627#section2.4)
+        }
+        break;
+    }
+    case QJsonValue::String:
+        // No schema here, dates are only rewritten when detection is requested
+        stringToJson(jsonValue.toString(), json, mDateExport == DetectDates);
+        break;
+    case QJsonValue::Array:
+        json += compact ? "[" : "[\n";
+        arrayContentToJson(jsonValue.toArray(), json, indent + (compact ? 0 : 1), compact);
+        json.append(4 * indent, ' ');
+        json += ']';
+        break;
+    case QJsonValue::Object:
+        json += compact ? "{" : "{\n";
+        objectContentToJson(jsonValue.toObject(), json, indent + (compact ? 0 : 1), compact);
+        json.append(4 * indent, ' ');
+        json += '}';
+        break;
+    case QJsonValue::Null:
+    default:
+        json += "null";
+    }
+}
+
+void QJsonModel::addException(const QStringList &exceptions)
+{
+    mExceptions = exceptions;
+}
+
+/**
+ * @brief QJsonModel::setArenaEnabled
+ * Documents loaded afterwards are allocated from a per-model slab arena and
+ * are released at once on the next load or on destruction.
+ * The current tree keeps its allocation until it is replaced.
+ */
+void QJsonModel::setArenaEnabled(bool enabled)
+{
+    mArenaEnabled = enabled;
+    if (enabled && !mArena)
+        mArena = new QJsonTreeItemArena;
+}
+
+bool QJsonModel::isArenaEnabled() const
+{
+    return mArenaEnabled;
+}
+
+/**
+ * @brief QJsonModel::setLazyLoading
+ * Documents loaded afterwards only get their first level of items, the
+ * children of a container are created by fetchMore() when it is expanded.
+ * Loading scans the text once to validate it and builds no QJsonDocument.
+ * Nested containers keep a copy of their text, which is parsed one level per
+ * expansion. Takes precedence over setLoadThreads().
+ */
+void QJsonModel::setLazyLoading(bool enabled)
+{
+    mLazyLoading = enabled;
+}
+
+bool QJsonModel::isLazyLoading() const
+{
+    return mLazyLoading;
+}
+
+/**
+ * @brief QJsonModel::setLoadThreads
+ * With more than one thread, load() and loadJson() build large arrays and
+ * objects in parallel from a parsed QJsonDocument instead of streaming.
+ */
+void QJsonModel::setLoadThreads(int threads)
+{
+    mLoadThreads = qMax(1, threads);
+}
+
+int QJsonModel::loadThreads() const
+{
+    return mLoadThreads;
+}
+
+/**
+ * @brief QJsonModel::setDateExport
+ * Selects how dates are written by json() and writeJson()
+ */
+void QJsonModel::setDateExport(DateExport mode)
+{
+    mDateExport = mode;
+}
+
+QJsonModel::DateExport QJsonModel::dateExport() const
+{
+    return mDateExport;
+}
+
+QJsonTreeItemArena *QJsonModel::treeArena() const
+{
+    return mArenaEnabled ? mArena : nullptr;
+}
+
+QJsonTreeItem *QJsonModel::itemFromIndex(const QModelIndex &index) const
+{
+    return index.isValid() ? static_cast<QJsonTreeItem*>(index.internalPointer()) : mRootItem;
+}
+
+//!< Arena of the current tree, items added by edits must come from the same allocator
+QJsonTreeItemArena *QJsonModel::editArena() const
+{
+    return mRootItem && mRootItem->isArenaAllocated() ? mArena : nullptr;
+}
+
+//!< Builds a parentless item for an edit, honouring lazy loading
+QJsonTreeItem *QJsonModel::createItem(const QString &key, const QJsonValue &value)
+{
+    QJsonTreeItem *item;
+    if (mLazyLoading && (value.isObject() || value.isArray())) {
+        item = QJsonTreeItem::create(nullptr, editArena());
+        item->setPending(value);
+    } else {
+        item = QJsonTreeItem::load(value, mExceptions, nullptr, editArena());
+    }
+    item->setKey(key);
+    item->setType(value.type());
+
+    return item;
+}
+
+//!< Releases a detached subtree, dropping its items from mDirtyItems and mKeyIndex
+void QJsonModel::deleteItem(QJsonTreeItem *item)
+{
+    forgetItems(item);
+    removeSearchEntries(item);
+    if (item->isArenaAllocated())
+        mArena->destroy(item);
+    else
+        delete item;
+}
+
+void QJsonModel::forgetItems(QJsonTreeItem *item)
+{
+    if (mDirtyItems.isEmpty() && mKeyIndex.isEmpty())
+        return;
+    if (item->isDirty())
+        mDirtyItems.removeOne(item);
+    if (!mKeyIndex.isEmpty())
+        mKeyIndex.remove(item);
+    for (int i = 0; i < item->childCount(); ++i)
+        forgetItems(item->child(i));
+}
+
+void QJsonModel::releaseTree()
+{
+    invalidatePlan();
+    invalidateSearch();
+    mDirtyItems.clear();
+    mKeyIndex.clear();
+    mChangedItems.clear();
+
+    if (mRootItem && mRootItem->isArenaAllocated())
+        mArena->clear();
+    else
+        delete mRootItem;
+    mRootItem = nullptr;
+
+    if (!mArenaEnabled) {
+        delete mArena;
+        mArena = nullptr;
+    }
 }
 
 /**
@@ -1163,165 +3722,1177 @@ void QJsonModel::addException(const QStringList &exceptions)
  */
 QByteArray QJsonModel::serialize() const
 {
-    QMap<int, QByteArray> map = serialize(mRootItem);
-    QByteArray arr;
+    QByteArray arr(serializedSize(), Qt::Uninitialized);
+    serialize(arr.data(), arr.size());
+
+#ifdef QT_DEBUG
+    qDebug() << arr;
+    qDebug() << QString::fromLatin1(arr).toUtf8();
+    std::cout << QString::fromLatin1(arr).toUtf8().toStdString() << std::endl;
+    std::cout << arr.data() << std::endl;
+    std::cout << "arr size = " << arr.size() << std::endl;
+
+    for (int i = 0; i < arr.size(); ++i) {
+        int16_t val = int16_t(arr[i]) >= 0 ? int16_t(arr[i]) : (256 + int16_t(arr[i]));
+        std::cout << val << '\t';
+    }
+    std::cout << '\n';
+
+    for (int i = 0; i < arr.size(); ++i) {
+        szn::print(arr[i]);
+        std::cout << '\t';
+    }
+    std::cout << '\n';
+#endif
+
+    return arr;
+}
+
+/**
+ * @brief QJsonModel::serialize
+ * Writes the register image into a caller provided buffer in one pass over
+ * the precompiled serialization plan, without allocating.
+ * @param data destination buffer
+ * @param size size of the buffer, at least serializedSize()
+ * @return number of bytes written or -1 if the buffer is too small
+ */
+int QJsonModel::serialize(char *data, int size) const
+{
+    const QVector<PlanSlot> &leaves = plan();
+    if (size < mPlanSize)
+        return -1;
+
+    for (const PlanSlot &slot : leaves)
+        slot.item->serializeTo(data + slot.offset);
+
+    return mPlanSize;
+}
+
+//! Size in bytes of the image produced by serialize()
+int QJsonModel::serializedSize() const
+{
+    plan();
+    return mPlanSize;
+}
+
+QMap<int, QByteArray> QJsonModel::serializeToMap(bool RwOnly) const
+{
+    QMap<int, QByteArray> map;
+
+    for (const PlanSlot &slot : plan()) {
+        if (RwOnly && slot.item->editMode() == QJsonTreeItem::R)
+            continue;
+        QByteArray bytes(slot.size, Qt::Uninitialized);
+        slot.item->serializeTo(bytes.data());
+        map.insert(slot.address, bytes);
+    }
+
+    return map;
+}
+
+bool QJsonModel::hasDirtyItems() const
+{
+    return !mDirtyItems.isEmpty();
+}
+
+/**
+ * @brief QJsonModel::takeDirtyRanges
+ * Collects the fields edited since the last call, merges fields that are
+ * adjacent in the address space and clears their dirty flags.
+ * @return start address -> bytes to write back to the device
+ */
+QMap<int, QByteArray> QJsonModel::takeDirtyRanges()
+{
+    QMap<int, QByteArray> map;
+    std::sort(mDirtyItems.begin(), mDirtyItems.end(), [](const QJsonTreeItem *a, const QJsonTreeItem *b) {
+        return a->address() < b->address();
+    });
+
+    int start = 0;
+    int end = 0;
+    for (QJsonTreeItem *item : qAsConst(mDirtyItems)) {
+        QByteArray bytes(item->size(), Qt::Uninitialized);
+        item->serializeTo(bytes.data());
+        if (!map.isEmpty() && item->address() == end) {
+            map[start].append(bytes);
+        } else {
+            start = item->address();
+            map.insert(start, bytes);
+        }
+        end = item->address() + item->size();
+        item->setDirty(false);
+    }
+    mDirtyItems.clear();
+
+    return map;
+}
+
+/**
+ * @brief QJsonModel::plan
+ * Returns the serialization plan: described leaves sorted by address, each
+ * with its offset in the image produced by serialize(). The image is the
+ * concatenation of the fields in address order. The plan is rebuilt lazily
+ * after the tree structure changed.
+ */
+const QVector<QJsonModel::PlanSlot> &QJsonModel::plan() const
+{
+    if (!mPlanValid) {
+        mPlan.clear();
+        collectLeaves(mRootItem, mPlan);
+        std::stable_sort(mPlan.begin(), mPlan.end(), [](const PlanSlot &a, const PlanSlot &b) {
+            return a.address < b.address;
+        });
+        int offset = 0;
+        for (PlanSlot &slot : mPlan) {
+            slot.offset = offset;
+            offset += slot.size;
+        }
+        mPlanSize = offset;
+        mPlanValid = true;
+    }
+
+    return mPlan;
+}
+
+void QJsonModel::collectLeaves(QJsonTreeItem *item, QVector<PlanSlot> &leaves) const
+{
+    int nchild = item->childCount();
+    for (int i = 0; i < nchild; ++i) {
+        auto ch = item->child(i);
+        if (ch->isLeaf()) {
+            PlanSlot slot;
+            slot.offset = 0;
+            slot.address = ch->address();
+            slot.size = ch->size();
+            slot.item = ch;
+            leaves.append(slot);
+        } else {
+            collectLeaves(ch, leaves);
+        }
+    }
+}
+
+void QJsonModel::invalidatePlan()
+{
+    mPlanValid = false;
+    mPlan.clear();
+    mPlanSize = 0;
+}
+
+// Compare two variants.
+bool itemLessThan(const QJsonTreeItem &v1, const QJsonTreeItem &v2)
+{
+    return v1.address() < v2.address();
+}
+
+bool QJsonModel::deserialize(const QByteArray &arr)
+{
+    return deserialize(arr.constData(), arr.size());
+}
+
+/**
+ * @brief QJsonModel::deserialize
+ * Updates described leaves from a raw register image, reading each field in
+ * place at its address. Only leaves whose value changed are reported, with
+ * one dataChanged() per run of adjacent rows, so views keep their state.
+ * @param data register image
+ * @param size size of the image in bytes
+ * @return false if some field lies outside of the image
+ */
+bool QJsonModel::deserialize(const char *data, int size)
+{
+    return deserialize(mRootItem, data, size);
+}
+
+bool QJsonModel::deserialize(QJsonTreeItem *item, const char *data, int size)
+{
+    bool res = true;
+    int  nchild = item->childCount();
+    int  first = -1; // first row of the current run of changed leaves
+
+    for (int i = 0; i < nchild; ++i) {
+        auto ch = item->child(i);
+        bool changed = false;
+        if (ch->isLeaf()) {
+            auto key = ch->address();
+            if (key >= 0 && key <= size)
+                res &= ch->deserialize(data + key, size - key, &changed);
+            else
+                res = false;
+            if (changed) {
+                updateSearchEntry(ch);
+                if (mUpdateDepth > 0) {
+                    // reported by endUpdate()
+                    mChangedItems.append(ch);
+                    changed = false;
+                }
+            }
+        } else {
+            res &= deserialize(ch, data, size);
+        }
+
+        if (changed && first < 0) {
+            first = i;
+        } else if (!changed && first >= 0) {
+            emit dataChanged(createIndex(first, 1, item->child(first)), createIndex(i - 1, 1, item->child(i - 1)),
+                             {Qt::DisplayRole, Qt::EditRole, Qt::UserRole});
+            first = -1;
+        }
+    }
+
+    if (first >= 0) {
+        emit dataChanged(createIndex(first, 1, item->child(first)), createIndex(nchild - 1, 1, item->child(nchild - 1)),
+                         {Qt::DisplayRole, Qt::EditRole, Qt::UserRole});
+    }
+
+    return res;
+}
+
+//=========================================================================
+
+QJsonTreeDiff QJsonTreeDiff::compare(const QJsonTreeItem *from, const QJsonTreeItem *to, const QStringList &exceptions)
+{
+    QJsonTreeDiff diff;
+    diff.mExceptions = exceptions;
+    if (from && to)
+        diff.compareItems(from, to, QString());
+
+    return diff;
+}
+
+QJsonTreeDiff QJsonTreeDiff::compare(const QJsonModel &from, const QJsonModel &to)
+{
+    return compare(from.mRootItem, to.mRootItem, to.mExceptions);
+}
+
+const QVector<QJsonTreeDiff::Entry> &QJsonTreeDiff::entries() const
+{
+    return mEntries;
+}
+
+bool QJsonTreeDiff::isEmpty() const
+{
+    return mEntries.isEmpty();
+}
+
+QMap<int, int> QJsonTreeDiff::changedRanges() const
+{
+    QVector<QPair<int, int>> ranges = mRanges;
+    std::sort(ranges.begin(), ranges.end());
+
+    QMap<int, int> map;
+    int start = 0;
+    int end = 0;
+    for (const QPair<int, int> &range : qAsConst(ranges)) {
+        if (!map.isEmpty() && range.first <= end) {
+            end = qMax(end, range.first + range.second);
+            map[start] = end - start;
+        } else {
+            start = range.first;
+            end = range.first + range.second;
+            map.insert(start, range.second);
+        }
+    }
 
-    for (auto key : map.keys()) {
-        arr.append(map[key]);
+    return map;
+}
+
+QJsonArray QJsonTreeDiff::toJsonPatch() const
+{
+    QJsonArray patch;
+    for (const Entry &entry : mEntries) {
+        QJsonObject operation;
+        operation.insert("op", entry.op == Added ? "add" : entry.op == Removed ? "remove" : "replace");
+        operation.insert("path", entry.path);
+        if (entry.op != Removed)
+            operation.insert("value", entry.value);
+        patch.append(operation);
     }
 
-#ifdef QT_DEBUG
-    qDebug() << arr;
-    qDebug() << QString::fromLatin1(arr).toUtf8();
-    std::cout << QString::fromLatin1(arr).toUtf8().toStdString() << std::endl;
-    std::cout << arr.data() << std::endl;
-    std::cout << "arr size = " << arr.size() << std::endl;
+    return patch;
+}
 
-    for (int i = 0; i < arr.size(); ++i) {
-        int16_t val = int16_t(arr[i]) >= 0 ? int16_t(arr[i]) : (256 + int16_t(arr[i]));
-        std::cout << val << '\t';
+void QJsonTreeDiff::compareItems(const QJsonTreeItem *from, const QJsonTreeItem *to, const QString &path)
+{
+    const QJsonValue::Type type = from->type();
+    const bool isContainer = type == QJsonValue::Object || type == QJsonValue::Array;
+    if (type != to->type() || (isContainer && (from->isPending() || to->isPending()))) {
+        // Different kinds, or not expanded yet: compare the values as a whole
+        if (type != to->type() || from->toJsonValue(mExceptions) != to->toJsonValue(mExceptions))
+            addEntry(Changed, path, to);
+        return;
     }
-    std::cout << '\n';
 
-    for (int i = 0; i < arr.size(); ++i) {
-        szn::print(arr[i]);
-        std::cout << '\t';
+    if (type == QJsonValue::Object) {
+        QHash<QString, const QJsonTreeItem*> toChilds;
+        toChilds.reserve(to->childCount());
+        for (int i = 0; i < to->childCount(); ++i) {
+            const QJsonTreeItem *child = to->child(i);
+            toChilds.insert(child->key(), child);
+        }
+        for (int i = 0; i < from->childCount(); ++i) {
+            const QJsonTreeItem *child = from->child(i);
+            const QString childPath = path + '/' + pointerToken(child->key());
+            const QJsonTreeItem *match = toChilds.take(child->key());
+            if (match)
+                compareItems(child, match, childPath);
+            else
+                addEntry(Removed, childPath, child);
+        }
+        // Whatever is left was added, reported in the order of to
+        for (int i = 0; i < to->childCount() && !toChilds.isEmpty(); ++i) {
+            const QJsonTreeItem *child = to->child(i);
+            if (toChilds.remove(child->key()))
+                addEntry(Added, path + '/' + pointerToken(child->key()), child);
+        }
+    } else if (type == QJsonValue::Array) {
+        const int common = qMin(from->childCount(), to->childCount());
+        for (int i = 0; i < common; ++i)
+            compareItems(from->child(i), to->child(i),
+                         path + '/' + QString::number(i));
+        // Removed from the back, so the indices of the patch stay valid
+        for (int i = from->childCount() - 1; i >= common; --i)
+            addEntry(Removed, path + '/' + QString::number(i), from->child(i));
+        for (int i = common; i < to->childCount(); ++i)
+            addEntry(Added, path + '/' + QString::number(i), to->child(i));
+    } else if (from->value() != to->value()) {
+        addEntry(Changed, path, to);
     }
-    std::cout << '\n';
-#endif
+}
 
-    return arr;
+void QJsonTreeDiff::addEntry(Operation op, const QString &path, const QJsonTreeItem *item)
+{
+    Entry entry;
+    entry.op = op;
+    entry.path = path;
+    if (op != Removed)
+        entry.value = item->toJsonValue(mExceptions);
+    if (item->isLeaf()) {
+        entry.address = item->address();
+        entry.size = item->size();
+    }
+    mEntries.append(entry);
+    collectRanges(item);
 }
 
-QMap<int, QByteArray> QJsonModel::serializeToMap(bool RwOnly) const
+void QJsonTreeDiff::collectRanges(const QJsonTreeItem *item)
 {
-    QMap<int, QByteArray> map;
+    if (item->isLeaf()) {
+        if (item->size() > 0)
+            mRanges.append(qMakePair(item->address(), item->size()));
+        return;
+    }
+    for (int i = 0; i < item->childCount(); ++i)
+        collectRanges(item->child(i));
+}
 
-    map = serialize(mRootItem, RwOnly);
+//=========================================================================
 
-    return map;
+/**
+ * @brief QJsonModel::setSearchEnabled
+ * Keeps a trigram index of keys and values, built on a worker thread after
+ * every load. Value and structural edits update the entries they touch.
+ */
+void QJsonModel::setSearchEnabled(bool enabled)
+{
+    mSearchEnabled = enabled;
+    if (enabled)
+        buildSearchIndex();
+    else
+        invalidateSearch();
 }
 
-// Compare two variants.
-bool itemLessThan(const QJsonTreeItem &v1, const QJsonTreeItem &v2)
+bool QJsonModel::isSearchEnabled() const
 {
-    return v1.address() < v2.address();
+    return mSearchEnabled;
 }
 
-QMap<int, QByteArray> QJsonModel::serialize(QJsonTreeItem *item, bool RwOnly) const
+bool QJsonModel::isSearchIndexReady() const
 {
-    auto type   = item->type();
-    int  nchild = item->childCount();
-    QMap<int, QByteArray> byteArrayMap;
-
-    if (QJsonValue::Object == type) {
-        for (int i = 0; i < nchild; ++i) {
-            auto ch = item->child(i);
-            if (ch->isLeaf()) {
-                auto key = ch->address();
-                if (RwOnly) {
-                    auto mode = ch->editMode();
-                    if (mode != QJsonTreeItem::R)
-                        byteArrayMap.insert(key, ch->serialize());
-                } else {
-                    byteArrayMap.insert(key, ch->serialize());
-                }
-            } else {
-#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-                byteArrayMap.unite(serialize(ch, RwOnly));
-#else
-                byteArrayMap.insert(serialize(ch, RwOnly));
-#endif
-            }
+    return mSearch != nullptr;
+}
+
+/**
+ * @brief QJsonModel::search
+ * Case insensitive substring search over member keys and displayed values,
+ * positions of array elements are not matched. Without a
+ * ready index the tree is scanned, which is correct but slow on big documents.
+ * Items of containers that were not expanded yet are not searched.
+ * @return column 0 indexes of the matching items
+ */
+QModelIndexList QJsonModel::search(const QString &text)
+{
+    QModelIndexList matches;
+    if (!mRootItem || text.isEmpty())
+        return matches;
+
+    const QString needle = text.toLower();
+    if (!mSearch) {
+        buildSearchIndex();
+        searchItems(mRootItem, needle, matches);
+        return matches;
+    }
+
+    QVector<int> candidates;
+    if (needle.size() < 3) {
+        candidates.reserve(mSearch->texts.size());
+        for (int i = 0; i < mSearch->texts.size(); ++i)
+            candidates.append(i);
+    } else {
+        // every match holds all trigrams of the needle, the rarest one bounds the candidates
+        const QVector<int> *rarest = nullptr;
+        for (int i = 0; i + 3 <= needle.size(); ++i) {
+            auto it = mSearch->trigrams.constFind(SearchIndex::trigram(needle.constData() + i));
+            if (it == mSearch->trigrams.constEnd())
+                return matches;
+            if (!rarest || it->size() < rarest->size())
+                rarest = &*it;
         }
-        return byteArrayMap;
-    } else if (QJsonValue::Array == type) {
-        for (int i = 0; i < nchild; ++i) {
-            auto ch = item->child(i);
-#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-                byteArrayMap.unite(serialize(ch, RwOnly));
-#else
-            byteArrayMap.insert(serialize(ch, RwOnly));
-#endif
+        candidates = *rarest;
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    }
+
+    for (int entry : qAsConst(candidates)) {
+        QJsonTreeItem *item = mSearch->items.at(entry);
+        if (item && mSearch->texts.at(entry).contains(needle))
+            matches.append(createIndex(item->row(), 0, item));
+    }
+
+    return matches;
+}
+
+void QJsonModel::searchItems(QJsonTreeItem *item, const QString &needle, QModelIndexList &matches)
+{
+    for (int i = 0; i < item->childCount(); ++i) {
+        QJsonTreeItem *child = item->child(i);
+        if (searchKey(child).contains(needle, Qt::CaseInsensitive)
+                || child->value().toString().contains(needle, Qt::CaseInsensitive))
+            matches.append(createIndex(i, 0, child));
+        searchItems(child, needle, matches);
+    }
+}
+
+//!< Starts building the index from a snapshot of the tree, values are stringified on the worker thread
+void QJsonModel::buildSearchIndex()
+{
+    if (!mSearchEnabled || !mRootItem || mSearch || mSearchPending)
+        return;
+
+    if (!mSearchWatcher) {
+        mSearchWatcher = new QFutureWatcher<SearchIndex*>(this);
+        connect(mSearchWatcher, &QFutureWatcher<SearchIndex*>::finished, this, &QJsonModel::finishSearchIndex);
+    }
+
+    QVector<QJsonTreeItem*> items;
+    items.reserve(countItems(mRootItem));
+    collectItems(mRootItem, items);
+    QVector<QString> keys;
+    QVector<QVariant> values;
+    keys.reserve(items.size());
+    values.reserve(items.size());
+    for (QJsonTreeItem *item : qAsConst(items)) {
+        keys.append(searchKey(item));
+        values.append(item->value());
+    }
+
+    const int generation = mSearchGeneration;
+    mSearchPending = true;
+    mSearchWatcher->setFuture(QtConcurrent::run([items, keys, values, generation]() {
+        SearchIndex *index = new SearchIndex;
+        index->generation = generation;
+        index->items = items;
+        index->texts.resize(items.size());
+        index->entries.reserve(items.size());
+        for (int i = 0; i < items.size(); ++i) {
+            index->entries.insert(items.at(i), i);
+            index->setText(i, keys.at(i), values.at(i));
         }
-        return byteArrayMap;
-    } else {
+        return index;
+    }));
+}
 
+void QJsonModel::collectItems(QJsonTreeItem *item, QVector<QJsonTreeItem*> &items)
+{
+    for (int i = 0; i < item->childCount(); ++i) {
+        items.append(item->child(i));
+        collectItems(item->child(i), items);
     }
 }
 
-bool QJsonModel::deserialize(const QByteArray &arr)
+void QJsonModel::finishSearchIndex()
 {
-    beginResetModel();
+    if (!mSearchPending)
+        return;
 
-    auto res = deserialize(mRootItem, arr);
+    mSearchPending = false;
+    SearchIndex *index = mSearchWatcher->result();
+    // items of an outdated snapshot may be gone already, the tree is indexed again
+    if (index->generation != mSearchGeneration) {
+        delete index;
+        buildSearchIndex();
+        return;
+    }
 
-    endResetModel();
+    delete mSearch;
+    mSearch = index;
+    emit searchIndexReady();
+}
 
-    return res;
+//! Keys of members are searched, positions of array elements are not
+QString QJsonModel::searchKey(QJsonTreeItem *item)
+{
+    QJsonTreeItem *parent = item->parent();
+    return parent && parent->type() == QJsonValue::Array ? QString() : item->key();
 }
 
-bool QJsonModel::deserialize(QJsonTreeItem *item, const QByteArray &arr)
+//!< Indexes an item inserted into the tree together with its subtree
+void QJsonModel::addSearchEntries(QJsonTreeItem *item)
 {
-    auto type   = item->type();
-    int  nchild = item->childCount();
-    QMap<int, QByteArray> byteArrayMap;
-
-    if (QJsonValue::Object == type) {
-        for (int i = 0; i < nchild; ++i) {
-            auto ch = item->child(i);
-            if (ch->isLeaf()) {
-                auto key = ch->address();
-                auto len = ch->size();
-                ch->deserialize(arr.mid(key, len));
-            } else {
-                deserialize(ch, arr);
+    if (!mSearch) {
+        // the snapshot of a running build does not hold the item
+        if (mSearchPending)
+            ++mSearchGeneration;
+        return;
+    }
+
+    mSearch->add(item, searchKey(item));
+    for (int i = 0; i < item->childCount(); ++i)
+        addSearchEntries(item->child(i));
+}
+
+//!< Drops the entries of an item and its subtree before they are deleted
+void QJsonModel::removeSearchEntries(QJsonTreeItem *item)
+{
+    if (!mSearch) {
+        if (mSearchPending)
+            ++mSearchGeneration;
+        return;
+    }
+
+    mSearch->remove(item);
+    for (int i = 0; i < item->childCount(); ++i)
+        removeSearchEntries(item->child(i));
+}
+
+//!< Drops the whole index when the tree is replaced, search() rebuilds it on demand
+void QJsonModel::invalidateSearch()
+{
+    ++mSearchGeneration;
+    delete mSearch;
+    mSearch = nullptr;
+}
+
+void QJsonModel::updateSearchEntry(QJsonTreeItem *item)
+{
+    if (!mSearch) {
+        // the snapshot of a running build holds the old value
+        if (mSearchPending)
+            ++mSearchGeneration;
+        return;
+    }
+
+    const int entry = mSearch->entries.value(item, -1);
+    if (entry >= 0)
+        mSearch->setText(entry, searchKey(item), item->value());
+}
+
+//=========================================================================
+
+QJsonFilterProxyModel::QJsonFilterProxyModel(QObject *parent)
+    : QSortFilterProxyModel(parent)
+{
+    // DisplayRole holds formatted text, numbers must not be sorted as strings
+    setSortRole(Qt::UserRole);
+}
+
+/**
+ * @brief QJsonFilterProxyModel::setSourceModel
+ * Matches are searched again whenever rows or values of the source change,
+ * and once its search index is ready.
+ */
+void QJsonFilterProxyModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    for (const QMetaObject::Connection &connection : qAsConst(mSourceConnections))
+        disconnect(connection);
+    mSourceConnections.clear();
+    QSortFilterProxyModel::setSourceModel(sourceModel);
+    if (sourceModel) {
+        mSourceConnections
+                << connect(sourceModel, &QAbstractItemModel::modelReset, this, &QJsonFilterProxyModel::refresh)
+                << connect(sourceModel, &QAbstractItemModel::rowsInserted, this, &QJsonFilterProxyModel::sourceChanged)
+                << connect(sourceModel, &QAbstractItemModel::rowsRemoved, this, &QJsonFilterProxyModel::sourceChanged)
+                << connect(sourceModel, &QAbstractItemModel::dataChanged, this, &QJsonFilterProxyModel::sourceChanged);
+        if (QJsonModel *model = qobject_cast<QJsonModel*>(sourceModel))
+            mSourceConnections << connect(model, &QJsonModel::searchIndexReady, this, &QJsonFilterProxyModel::sourceChanged);
+    }
+    refresh();
+}
+
+/**
+ * @brief QJsonFilterProxyModel::setSearchText
+ * Shows only the items matching text and their ancestors, an empty text shows everything
+ */
+void QJsonFilterProxyModel::setSearchText(const QString &text)
+{
+    mSearchText = text;
+    refresh();
+}
+
+QString QJsonFilterProxyModel::searchText() const
+{
+    return mSearchText;
+}
+
+//! Runs the search again, e.g. after structural edits of the source model
+void QJsonFilterProxyModel::refresh()
+{
+    mAccepted.clear();
+    QJsonModel *model = qobject_cast<QJsonModel*>(sourceModel());
+    if (model && !mSearchText.isEmpty()) {
+        for (const QModelIndex &match : model->search(mSearchText)) {
+            // stop at the first ancestor that is already in, its chain is too
+            for (QModelIndex index = match; index.isValid(); index = index.parent()) {
+                if (mAccepted.contains(index.internalPointer()))
+                    break;
+                mAccepted.insert(index.internalPointer());
             }
         }
-    } else if (QJsonValue::Array == type) {
-        for (int i = 0; i < nchild; ++i) {
-            auto ch = item->child(i);
-            deserialize(ch, arr);
-        }
-    } else {
+    }
+    invalidateFilter();
+}
+
+//!< Without a search text everything is shown already, nothing to refilter
+void QJsonFilterProxyModel::sourceChanged()
+{
+    if (!mSearchText.isEmpty())
+        refresh();
+}
+
+bool QJsonFilterProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+{
+    if (mSearchText.isEmpty())
+        return true;
+
+    return mAccepted.contains(sourceModel()->index(sourceRow, 0, sourceParent).internalPointer());
+}
+
+//=========================================================================
 
+/*
+ * Snapshot layout, all sections 8 byte aligned and in host byte order:
+ *   SnapshotHeader
+ *   SnapshotNode[nodeCount]        items in pre-order, children follow their parent
+ *   quint64[stringCount + 1]       offsets of the interned strings in UTF-16 units
+ *   ushort[]                       UTF-16 data of all strings, padded to 8 bytes
+ * The checksum covers everything after the header.
+ */
+namespace {
+
+const char SnapshotMagic[4] = { 'Q', 'J', 'M', 'S' };
+const quint32 SnapshotVersion = 2;
+const quint32 SnapshotByteOrder = 0x01020304;
+const quint32 NoString = 0xffffffff;
+
+struct SnapshotHeader {
+    char magic[4];
+    quint32 version;
+    quint32 byteOrder;
+    quint32 nodeCount;
+    quint32 stringCount;
+    quint32 reserved;
+    quint64 sourceKey;
+    quint64 stringsOffset;
+    quint64 totalSize;
+    quint64 checksum;
+};
+
+//! Type of the stored value, integers and floats keep the width they were loaded with
+enum SnapshotValue : quint8 {
+    InvalidValue, NullValue, BoolValue, Int32Value, Int64Value, UInt32Value, UInt64Value,
+    FloatValue, DoubleValue, StringValue, DateValue
+};
+
+enum SnapshotFlags : quint8 {
+    LeafFlag = 1,
+    RegisterFlag = 2
+};
+
+struct SnapshotNode {
+    quint64 value;        //!< Bits of the scalar, string index or julian day, see valueType
+    quint32 key;
+    quint32 childCount;
+    quint32 description;
+    qint32 address;
+    qint32 size;
+    quint8 type;          //!< QJsonValue::Type
+    quint8 valueType;     //!< SnapshotValue
+    quint8 fieldType;
+    quint8 editMode;
+    quint8 flags;
+    quint8 padding[3];
+};
+
+static_assert(sizeof(SnapshotHeader) % 8 == 0, "snapshot sections must stay 8 byte aligned");
+static_assert(sizeof(SnapshotNode) == 40, "snapshot node layout changed");
+
+//!< FNV-1a over 64 bit words, trailing bytes are hashed one by one
+quint64 snapshotChecksum(quint64 hash, const char *data, qint64 size)
+{
+    const quint64 prime = Q_UINT64_C(0x100000001b3);
+    qint64 i = 0;
+    for (; i + 8 <= size; i += 8) {
+        quint64 word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
     }
+    for (; i < size; ++i)
+        hash = (hash ^ uchar(data[i])) * prime;
 
-    return true;
+    return hash;
 }
 
-QJsonValue QJsonModel::genJson(QJsonTreeItem *item) const
+const quint64 ChecksumBasis = Q_UINT64_C(0xcbf29ce484222325);
+
+/**
+ * @brief The SnapshotWriter class
+ * Flattens a tree into snapshot nodes and a table of interned strings
+ */
+class SnapshotWriter
 {
-    auto type   = item->type();
-    int  nchild = item->childCount();
+public:
+    explicit SnapshotWriter(const QStringList &exceptions)
+        : mExceptions(exceptions)
+    {
+    }
+
+    void add(const QJsonTreeItem *item)
+    {
+        // containers that were not expanded yet are written from their source, like expanded items
+        const QJsonValue pending = item->pendingValue();
+        SnapshotNode node;
+        memset(&node, 0, sizeof(node));
+        node.key = intern(item->key());
+        node.childCount = item->isPending() ? childCount(pending) : quint32(item->childCount());
+        node.description = item->hasRegisterInfo() ? intern(item->description()) : NoString;
+        node.address = item->address();
+        node.size = item->size();
+        node.type = quint8(item->type());
+        node.fieldType = quint8(item->fieldType());
+        node.editMode = quint8(item->editMode());
+        node.flags = (item->isLeaf() ? LeafFlag : 0) | (item->hasRegisterInfo() ? RegisterFlag : 0);
+        setValue(node, item->value());
+        mNodes.append(node);
+
+        if (item->isPending())
+            addChildren(pending);
+        for (int i = 0; i < item->childCount(); ++i)
+            add(item->child(i));
+    }
 
-    if (QJsonValue::Object == type) {
-        QJsonObject jo;
-        for (int i = 0; i < nchild; ++i) {
-            auto ch = item->child(i);
-            auto key = ch->key();
-            jo.insert(key, genJson(ch));
+    bool write(QIODevice *device, quint64 sourceKey)
+    {
+        QVector<quint64> offsets;
+        offsets.reserve(mStrings.size() + 1);
+        quint64 units = 0;
+        for (const QString &str : qAsConst(mStrings)) {
+            offsets.append(units);
+            units += quint64(str.size());
         }
-        return  jo;
-    } else if (QJsonValue::Array == type) {
-        QJsonArray arr;
-        for (int i = 0; i < nchild; ++i) {
-            auto ch = item->child(i);
-            arr.append(genJson(ch));
+        offsets.append(units);
+
+        QByteArray data;
+        data.reserve(int(units * 2 + 8));
+        for (const QString &str : qAsConst(mStrings))
+            data.append(reinterpret_cast<const char*>(str.utf16()), str.size() * 2);
+        data.append((8 - data.size() % 8) % 8, '\0');
+
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SnapshotMagic, sizeof(header.magic));
+        header.version = SnapshotVersion;
+        header.byteOrder = SnapshotByteOrder;
+        header.nodeCount = quint32(mNodes.size());
+        header.stringCount = quint32(mStrings.size());
+        header.sourceKey = sourceKey;
+
+        const char *nodes = reinterpret_cast<const char*>(mNodes.constData());
+        const qint64 nodesSize = qint64(mNodes.size()) * qint64(sizeof(SnapshotNode));
+        const char *table = reinterpret_cast<const char*>(offsets.constData());
+        const qint64 tableSize = qint64(offsets.size()) * qint64(sizeof(quint64));
+        header.stringsOffset = sizeof(header) + quint64(nodesSize);
+        header.totalSize = header.stringsOffset + quint64(tableSize) + quint64(data.size());
+        quint64 checksum = snapshotChecksum(ChecksumBasis, nodes, nodesSize);
+        checksum = snapshotChecksum(checksum, table, tableSize);
+        header.checksum = snapshotChecksum(checksum, data.constData(), data.size());
+
+        return device->write(reinterpret_cast<const char*>(&header), sizeof(header)) == qint64(sizeof(header))
+                && device->write(nodes, nodesSize) == nodesSize
+                && device->write(table, tableSize) == tableSize
+                && device->write(data) == data.size();
+    }
+
+private:
+    //!< Nodes of the items QJsonTreeItem::load() would create from key and value
+    void add(const QString &key, const QJsonValue &value)
+    {
+        SnapshotNode node;
+        memset(&node, 0, sizeof(node));
+        node.key = intern(key);
+        node.childCount = childCount(value);
+        node.description = NoString;
+        node.type = quint8(value.type());
+        if (!value.isObject() && !value.isArray())
+            setValue(node, value.toVariant());
+        mNodes.append(node);
+
+        addChildren(value);
+    }
+
+    void addChildren(const QJsonValue &value)
+    {
+        if (value.isObject()) {
+            const QJsonObject obj = value.toObject();
+            for (auto it = obj.constBegin(); it != obj.constEnd(); ++it)
+                if (!contains(mExceptions, it.key()))
+                    add(it.key(), it.value());
+        } else if (value.isArray()) {
+            const QJsonArray arr = value.toArray();
+            for (int i = 0; i < arr.size(); ++i)
+                add(QString::number(i), arr.at(i));
         }
-        return arr;
-    } else {
-        QJsonValue va;
-        switch(item->value().type()){
-        case QVariant::Bool: {
-            va = item->value().toBool();
+    }
+
+    quint32 childCount(const QJsonValue &value) const
+    {
+        if (value.isArray())
+            return quint32(value.toArray().size());
+        if (!value.isObject())
+            return 0;
+
+        quint32 count = 0;
+        const QJsonObject obj = value.toObject();
+        for (auto it = obj.constBegin(); it != obj.constEnd(); ++it)
+            if (!contains(mExceptions, it.key()))
+                ++count;
+        return count;
+    }
+
+    quint32 intern(const QString &str)
+    {
+        auto it = mIndex.constFind(str);
+        if (it != mIndex.constEnd())
+            return it.value();
+
+        const quint32 index = quint32(mStrings.size());
+        mStrings.append(str);
+        mIndex.insert(str, index);
+        return index;
+    }
+
+    void setValue(SnapshotNode &node, const QVariant &value)
+    {
+        switch (value.userType()) {
+        case QMetaType::UnknownType:
+            node.valueType = InvalidValue;
+            break;
+        case QMetaType::Nullptr:
+            node.valueType = NullValue;
+            break;
+        case QMetaType::Bool:
+            node.valueType = BoolValue;
+            node.value = value.toBool();
+            break;
+        case QMetaType::Int:
+        case QMetaType::Short:
+        case QMetaType::Long:
+        case QMetaType::LongLong: {
+            // long is restored as int or qlonglong, whichever has its width
+            const bool wide = value.userType() == QMetaType::LongLong
+                    || (value.userType() == QMetaType::Long && sizeof(long) > sizeof(int));
+            node.valueType = wide ? Int64Value : Int32Value;
+            const qint64 v = value.toLongLong();
+            memcpy(&node.value, &v, sizeof(v));
+            break;
+        }
+        case QMetaType::UInt:
+        case QMetaType::UShort:
+        case QMetaType::ULong:
+        case QMetaType::ULongLong: {
+            const bool wide = value.userType() == QMetaType::ULongLong
+                    || (value.userType() == QMetaType::ULong && sizeof(ulong) > sizeof(uint));
+            node.valueType = wide ? UInt64Value : UInt32Value;
+            node.value = value.toULongLong();
+            break;
+        }
+        case QMetaType::Float:
+        case QMetaType::Double: {
+            node.valueType = value.userType() == QMetaType::Float ? FloatValue : DoubleValue;
+            const double v = value.toDouble();
+            memcpy(&node.value, &v, sizeof(v));
             break;
         }
+        case QMetaType::QDate:
+            node.valueType = DateValue;
+            node.value = quint64(value.toDate().toJulianDay());
+            break;
         default:
-            va = item->value().toString();
+            node.valueType = StringValue;
+            node.value = intern(value.toString());
+        }
+    }
+
+    const QStringList &mExceptions;
+    QVector<SnapshotNode> mNodes;
+    QVector<QString> mStrings;
+    QHash<QString, quint32> mIndex;
+};
+
+QVariant snapshotValue(const SnapshotNode &node, const QVector<QString> &strings)
+{
+    switch (node.valueType) {
+    case NullValue:
+        return QVariant::fromValue(nullptr);
+    case BoolValue:
+        return bool(node.value);
+    case Int32Value:
+    case Int64Value: {
+        qint64 v;
+        memcpy(&v, &node.value, sizeof(v));
+        if (node.valueType == Int32Value)
+            return int(v);
+        return qlonglong(v);
+    }
+    case UInt32Value:
+        return uint(node.value);
+    case UInt64Value:
+        return qulonglong(node.value);
+    case FloatValue:
+    case DoubleValue: {
+        double v;
+        memcpy(&v, &node.value, sizeof(v));
+        if (node.valueType == FloatValue)
+            return float(v);
+        return v;
+    }
+    case DateValue:
+        return QDate::fromJulianDay(qint64(node.value));
+    case StringValue:
+        return strings.value(int(node.value));
+    default:
+        return QVariant();
+    }
+}
+
+/**
+ * @brief readSnapshot
+ * Rebuilds the tree stored by SnapshotWriter, checking layout, source key and checksum
+ * @return null if the snapshot is corrupt, of another version or made from other sources
+ */
+QJsonTreeItem *readSnapshot(const char *data, qint64 size, quint64 sourceKey, QJsonTreeItemArena *arena,
+                            QString *error)
+{
+    SnapshotHeader header;
+    if (size < qint64(sizeof(header))) {
+        *error = "snapshot truncated";
+        return nullptr;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SnapshotMagic, sizeof(header.magic)) != 0 || header.byteOrder != SnapshotByteOrder) {
+        *error = "not a snapshot of this platform";
+        return nullptr;
+    }
+    if (header.version != SnapshotVersion) {
+        *error = "snapshot version mismatch";
+        return nullptr;
+    }
+    if (sourceKey && header.sourceKey != sourceKey) {
+        *error = "snapshot is stale";
+        return nullptr;
+    }
+
+    const quint64 nodesSize = quint64(header.nodeCount) * sizeof(SnapshotNode);
+    const quint64 tableSize = (quint64(header.stringCount) + 1) * sizeof(quint64);
+    if (header.totalSize != quint64(size) || header.nodeCount == 0
+            || header.stringsOffset != sizeof(header) + nodesSize
+            || header.stringsOffset + tableSize > quint64(size)) {
+        *error = "snapshot layout is corrupt";
+        return nullptr;
+    }
+    if (snapshotChecksum(ChecksumBasis, data + sizeof(header), size - qint64(sizeof(header))) != header.checksum) {
+        *error = "snapshot checksum mismatch";
+        return nullptr;
+    }
+
+    // Interned strings are decoded once and shared by all items using them
+    const char *table = data + header.stringsOffset;
+    const ushort *chars = reinterpret_cast<const ushort*>(table + tableSize);
+    const quint64 charCount = (quint64(size) - header.stringsOffset - tableSize) / 2;
+    QVector<QString> strings;
+    strings.reserve(int(header.stringCount));
+    for (quint32 i = 0; i < header.stringCount; ++i) {
+        quint64 begin, end;
+        memcpy(&begin, table + i * sizeof(quint64), sizeof(begin));
+        memcpy(&end, table + (i + 1) * sizeof(quint64), sizeof(end));
+        if (begin > end || end > charCount) {
+            *error = "snapshot string table is corrupt";
+            return nullptr;
+        }
+        strings.append(QString(reinterpret_cast<const QChar*>(chars + begin), int(end - begin)));
+    }
+
+    struct Open {
+        QJsonTreeItem *item;
+        quint32 remaining;
+    };
+    QVector<Open> stack;
+    QJsonTreeItem *root = nullptr;
+    const char *nodes = data + sizeof(header);
+    for (quint32 i = 0; i < header.nodeCount; ++i) {
+        SnapshotNode node;
+        memcpy(&node, nodes + i * sizeof(SnapshotNode), sizeof(node));
+        if ((i > 0 && stack.isEmpty()) || node.key >= header.stringCount
+                || (node.description != NoString && node.description >= header.stringCount)) {
+            *error = "snapshot nodes are corrupt";
             break;
         }
-        (item->value());
-        return va;
+
+        QJsonTreeItem *item = QJsonTreeItem::create(nullptr, arena);
+        item->setKey(strings.at(int(node.key)));
+        item->setType(QJsonValue::Type(node.type));
+        item->setValue(snapshotValue(node, strings));
+        if (node.flags & RegisterFlag) {
+            QJsonTreeItem::RegisterInfo info;
+            info.description = node.description != NoString ? strings.at(int(node.description)) : QString();
+            info.editMode = QJsonTreeItem::JsonEditMode(node.editMode);
+            info.fieldType = QJsonTreeItem::JsonFieldType(node.fieldType);
+            info.address = node.address;
+            info.size = node.size;
+            item->setRegisterInfo(info);
+        }
+        if (node.flags & LeafFlag)
+            item->setAsLeaf();
+
+        if (!root) {
+            root = item;
+        } else {
+            stack.last().item->appendChild(item);
+            --stack.last().remaining;
+        }
+        if (node.childCount > 0) {
+            Open open = { item, node.childCount };
+            stack.append(open);
+        }
+        while (!stack.isEmpty() && stack.last().remaining == 0)
+            stack.removeLast();
+    }
+
+    if (error->isEmpty() && !stack.isEmpty())
+        *error = "snapshot nodes are corrupt";
+    if (!error->isEmpty()) {
+        // arena items are released with the arena
+        if (!arena)
+            delete root;
+        return nullptr;
+    }
+
+    return root;
+}
+
+} // namespace
+
+/**
+ * @brief QJsonModel::saveSnapshot
+ * Writes the tree with its register metadata as a binary snapshot that
+ * loadSnapshot() maps back without parsing. The file is replaced atomically.
+ * @param sourceKey identifies the sources of the tree, see snapshotKey()
+ */
+bool QJsonModel::saveSnapshot(const QString &fileName, quint64 sourceKey) const
+{
+    if (!mRootItem)
+        return false;
+
+    SnapshotWriter writer(mExceptions);
+    writer.add(mRootItem);
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || !writer.write(&file, sourceKey) || !file.commit()) {
+        qDebug()<<Q_FUNC_INFO<<"cannot write snapshot:"<<file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief QJsonModel::loadSnapshot
+ * Replaces the tree by the one stored in a snapshot, mapping the file instead of reading it
+ * @param sourceKey if not 0, snapshots of other sources are rejected as stale
+ */
+bool QJsonModel::loadSnapshot(const QString &fileName, quint64 sourceKey)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug()<<Q_FUNC_INFO<<"cannot open snapshot:"<<file.errorString();
+        return false;
+    }
+
+    const qint64 size = file.size();
+    uchar *mapped = size > 0 ? file.map(0, size) : nullptr;
+    QByteArray buffer;
+    const char *data = reinterpret_cast<const char*>(mapped);
+    if (!mapped) {
+        buffer = file.readAll();
+        data = buffer.constData();
+    }
+
+    QJsonTreeItemArena *arena = mArenaEnabled ? new QJsonTreeItemArena : nullptr;
+    QString error;
+    QJsonTreeItem *root = readSnapshot(data, mapped ? size : buffer.size(), sourceKey, arena, &error);
+    if (mapped)
+        file.unmap(mapped);
+
+    return setRootItem(root, arena, error);
+}
+
+/**
+ * @brief QJsonModel::loadCached
+ * Loads the document (and its description if descFileName is not empty) from
+ * a snapshot made from the same files, otherwise parses the JSON and writes a
+ * fresh snapshot for the next start.
+ */
+bool QJsonModel::loadCached(const QString &fileName, const QString &descFileName, const QString &snapshotFileName)
+{
+    QStringList sources = { fileName };
+    if (!descFileName.isEmpty())
+        sources.append(descFileName);
+    const quint64 key = snapshotKey(sources);
+
+    if (QFileInfo::exists(snapshotFileName) && loadSnapshot(snapshotFileName, key))
+        return true;
+
+    const bool success = descFileName.isEmpty() ? load(fileName) : load(fileName, descFileName);
+    if (success)
+        saveSnapshot(snapshotFileName, key);
+
+    return success;
+}
+
+/**
+ * @brief QJsonModel::snapshotKey
+ * Identifies the current state of the source files and exceptions, a snapshot
+ * saved with one key is stale once any file is modified
+ */
+quint64 QJsonModel::snapshotKey(const QStringList &files) const
+{
+    QByteArray state;
+    QDataStream stream(&state, QIODevice::WriteOnly);
+    for (const QString &fileName : files) {
+        const QFileInfo info(fileName);
+        stream << info.absoluteFilePath() << info.size() << info.lastModified().toMSecsSinceEpoch();
     }
+    stream << mExceptions;
+
+    const quint64 key = snapshotChecksum(ChecksumBasis, state.constData(), state.size());
+    return key ? key : 1;
 }
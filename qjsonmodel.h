@@ -33,6 +33,13 @@
 #include <QJsonObject>
 #include <QIcon>
 #include <QValidator>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QSortFilterProxyModel>
+#include <QAtomicInt>
+#include <QFutureWatcher>
+#include <functional>
 
 namespace QUtf8Functions
 {
@@ -263,6 +270,9 @@ struct QUtf8BaseTraits
     }
 };
 
+//!< JSON string escaping of the writers, UTF-8 without the surrounding quotes
+QByteArray escapedString(const QString &s);
+
 class asciiValidator : public QValidator {
 public:
     explicit asciiValidator(QObject *parent = nullptr);
@@ -270,7 +280,20 @@ public:
     virtual QValidator::State validate(QString &str, int &) const override;
 };
 
+//! Integer range check over the whole 64 bit signed and unsigned span
+class rangeValidator : public QValidator {
+public:
+    rangeValidator(qint64 min, quint64 max, QObject *parent = nullptr);
+
+    virtual QValidator::State validate(QString &str, int &) const override;
+
+private:
+    qint64 mMin;
+    quint64 mMax;
+};
+
 class QJsonModel;
+class QJsonTreeItemArena;
 //class QJsonItem;
 
 static const QStringList tagNames = { "desc", "mode", "default", "address", "size", "type" };
@@ -288,11 +311,24 @@ public:
     enum JsonFieldType {
         STRING, INT, UINT, FLOAT, DOUBLE, DATE
     };
+    //! Register metadata of described fields, allocated only for items that have it
+    struct RegisterInfo {
+        QString description;
+        JsonEditMode editMode = RW;
+        JsonFieldType fieldType = STRING;
+        int address = 0;
+        int size = 0;
+    };
 
     QJsonTreeItem(QJsonTreeItem * parent = nullptr);
     ~QJsonTreeItem();
     void appendChild(QJsonTreeItem * item);
+    void insertChild(int row, QJsonTreeItem * item);
+    QJsonTreeItem *takeChild(int row);
+    QList<QJsonTreeItem*> takeChildren(int row, int count);
+    void moveChild(int from, int to);
     QJsonTreeItem *child(int row);
+    const QJsonTreeItem *child(int row) const;
     QJsonTreeItem *parent();
     int childCount() const;
     int row() const;
@@ -306,44 +342,129 @@ public:
     void setEditMode(const JsonEditMode &editMode);
     QString key() const;
     QVariant value() const;
+    QString displayValue() const;
     QString description() const;
     JsonFieldType fieldType() const;
     JsonEditMode editMode() const;
     int address() const;
     int size() const;
+    void setRegisterInfo(const RegisterInfo &info);
+    bool hasRegisterInfo() const;
     QMap<QString, QVariant> attributeMap() const;
     QByteArray serialize() const;
+    void serializeTo(char *dst) const;
     bool deserialize(const QByteArray &arr);
+    bool deserialize(const char *chunk, int length, bool *changed = nullptr);
     QJsonValue::Type type() const;
     bool isLeaf() const;
     void setAsLeaf();
+    bool isArenaAllocated() const;
+    //! Modified since the last write-back, see QJsonModel::takeDirtyRanges()
+    bool isDirty() const;
+    void setDirty(bool dirty);
+    //! Container whose children are not created yet, see QJsonModel::setLazyLoading()
+    bool isPending() const;
+    void setPending(const QJsonValue &source);
+    void setPending(const QByteArray &json);
+    QJsonValue pendingValue() const;
+    bool hasPendingChildren() const;
+    QJsonValue takePending();
+    QList<QJsonTreeItem*> takePendingChildren(const QStringList &exceptions = {}, QJsonTreeItemArena *arena = nullptr);
+    QJsonValue toJsonValue(const QStringList &exceptions = {}) const;
 
+    //!< Allocates an item from arena, or on the heap if arena is null
+    static QJsonTreeItem *create(QJsonTreeItem *parent, QJsonTreeItemArena *arena);
+    //!< Load JSON text incrementally, without building a QJsonDocument first
+    static QJsonTreeItem* loadStream(QIODevice *device, const QStringList &exceptions = {},
+                                     QJsonTreeItemArena *arena = nullptr, QString *errorString = nullptr,
+                                     const std::function<bool(qint64)> &progress = nullptr);
+    static QJsonTreeItem* loadStream(const char *data, qint64 size, const QStringList &exceptions = {},
+                                     QJsonTreeItemArena *arena = nullptr, QString *errorString = nullptr);
     //!< Load JSON
-    static QJsonTreeItem* load(const QJsonValue& value, const QStringList &exceptions = {}, QJsonTreeItem * parent = nullptr);
+    static QJsonTreeItem* load(const QJsonValue& value, const QStringList &exceptions = {}, QJsonTreeItem * parent = nullptr,
+                               QJsonTreeItemArena *arena = nullptr);
+    //!< Load JSON, building large containers on several threads
+    static QJsonTreeItem* loadParallel(const QJsonValue& value, int threads, const QStringList &exceptions = {},
+                                       QJsonTreeItemArena *arena = nullptr);
+    //!< Load the first level of JSON, nested containers are left pending
+    static QJsonTreeItem* loadLazy(const QJsonValue& value, const QStringList &exceptions = {}, QJsonTreeItem * parent = nullptr,
+                                   QJsonTreeItemArena *arena = nullptr);
+    //!< Load the first level of JSON text, nested containers keep their text until expanded
+    static QJsonTreeItem* loadLazy(const char *data, qint64 size, const QStringList &exceptions = {},
+                                   QJsonTreeItemArena *arena = nullptr, QString *errorString = nullptr);
+    //!< Parentless children of a container value, nested containers are left pending
+    static QList<QJsonTreeItem*> loadChildren(const QJsonValue& value, const QStringList &exceptions = {},
+                                              QJsonTreeItemArena *arena = nullptr);
     //!< Load JSON with description
     static QJsonTreeItem* loadWithDesc(const QJsonValue& value, const QJsonValue& description,
-                                       const QStringList &exceptions = {}, QJsonTreeItem * parent = nullptr);
+                                       const QStringList &exceptions = {}, QJsonTreeItem * parent = nullptr,
+                                       QJsonTreeItemArena *arena = nullptr);
     //!< Load by description, filling fields with default values
     static QJsonTreeItem* loadByDesc(const QJsonValue& description,
-                                     const QStringList &exceptions = {}, QJsonTreeItem * parent = nullptr);
+                                     const QStringList &exceptions = {}, QJsonTreeItem * parent = nullptr,
+                                     QJsonTreeItemArena *arena = nullptr);
+    static RegisterInfo registerInfoFromDescription(const QJsonObject &description);
     static JsonFieldType typeFromString(const QString &str);
     static QVariant defaultFromString(const QString &str, size_t size);
 
 protected:
 
 private:
+    Q_DISABLE_COPY(QJsonTreeItem)
+    friend class QJsonTreeItemArena;
+    RegisterInfo &registerInfo();
+    void updateRows(int first, int last);
+
+private:
+    // Hot traversal data first, register metadata lives in mRegister
     QString mKey;
     QVariant mValue;
-    QJsonValue::Type mType;
-    QString mDescription;
-    JsonEditMode mEditMode = RW;
-    int mLength;
-    JsonFieldType mFieldType = STRING;
-    int mAddress;
     QList<QJsonTreeItem*> mChilds;
     QJsonTreeItem * mParent;
-    QMap<QString, QVariant> mAttrMap; // Attribute -> value
+    RegisterInfo * mRegister = nullptr;
+    QJsonValue::Type mType = QJsonValue::Null;
+    int mRow = 0; //!< Cached position in mParent->mChilds, kept in sync by the child list modifiers
     bool mIsLeaf = false;
+    bool mArenaAllocated = false;
+    bool mDirty = false;
+    bool mPending = false; //!< mValue holds the source QJsonValue of the children
+    mutable bool mDisplayCached = false;
+    mutable QString mDisplay; //!< displayValue() of mValue, valid while mDisplayCached
+};
+
+/**
+ * @brief The QJsonTreeItemArena class
+ * Slab allocator for the nodes of one document. Nodes are constructed in
+ * place inside large slabs and the whole tree is released by clear() in
+ * one linear sweep instead of a recursive delete per node.
+ */
+class QJsonTreeItemArena
+{
+public:
+    explicit QJsonTreeItemArena(int slabSize = 4096);
+    ~QJsonTreeItemArena();
+    QJsonTreeItem *create(QJsonTreeItem *parent = nullptr);
+    //!< Destroys the item with its subtree, slots are reused by later create() calls
+    void destroy(QJsonTreeItem *item);
+    //!< Destroys every node and frees all slabs
+    void clear();
+    int count() const;
+    qint64 bytesAllocated() const;
+    //!< Takes over all nodes of other, which is left empty
+    void adopt(QJsonTreeItemArena &other);
+
+private:
+    Q_DISABLE_COPY(QJsonTreeItemArena)
+
+    struct Slab {
+        QJsonTreeItem *items;
+        int used;
+    };
+
+    QVector<Slab> mSlabs;
+    QVector<QJsonTreeItem*> mFree;
+    int mSlabSize;
+    int mCount = 0;
 };
 
 //---------------------------------------------------
@@ -352,6 +473,13 @@ class QJsonModel : public QAbstractItemModel
 {
     Q_OBJECT
 public:
+    //! How string values that hold dates are exported to JSON
+    enum DateExport {
+        SchemaDates,  //!< Fields described as DATE are written as dd.MM.yyyy
+        DetectDates,  //!< Any string holding an ISO date is rewritten as well (slow)
+        RawStrings    //!< All values are written verbatim, no per-value parsing
+    };
+
     explicit QJsonModel(QObject *parent = nullptr);
     QJsonModel(const QString& fileName, const QString& fileNameDesc = "", QObject *parent = nullptr);
     QJsonModel(QIODevice * device, QObject *parent = nullptr);
@@ -366,38 +494,263 @@ public:
     bool loadJson(const QByteArray& json);
     bool loadJson(const QByteArray& json, const QByteArray& descJson);
     bool loadJsonByDescription(const QByteArray& descJson);
+    bool loadAsync(const QString& fileName);
+    //! Binary snapshots of the tree, mapped back without parsing
+    bool saveSnapshot(const QString &fileName, quint64 sourceKey = 0) const;
+    bool loadSnapshot(const QString &fileName, quint64 sourceKey = 0);
+    bool loadCached(const QString &fileName, const QString &descFileName, const QString &snapshotFileName);
+    quint64 snapshotKey(const QStringList &files) const;
+    void cancelLoad();
+    bool isLoading() const;
     QVariant data(const QModelIndex &index, int role) const Q_DECL_OVERRIDE;
     bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) Q_DECL_OVERRIDE;
+    //! Value changes between these calls are reported in coalesced ranges
+    void beginUpdate();
+    void endUpdate();
+    bool isUpdating() const;
+    //! Applies many edits at once, all or none
+    bool setValues(const QVector<QPair<QModelIndex, QVariant>> &values);
+    const QValidator *validator(const QModelIndex &index) const;
     QVariant headerData(int section, Qt::Orientation orientation, int role) const Q_DECL_OVERRIDE;
     QModelIndex index(int row, int column,const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
     QModelIndex parent(const QModelIndex &index) const Q_DECL_OVERRIDE;
     int rowCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    bool canFetchMore(const QModelIndex &parent) const Q_DECL_OVERRIDE;
+    void fetchMore(const QModelIndex &parent) Q_DECL_OVERRIDE;
+    //! Structural edits, views are notified with row insertions, removals and moves
+    QModelIndex insertKey(const QModelIndex &parent, const QString &key, const QJsonValue &value);
+    QModelIndex insertElement(const QModelIndex &parent, int row, const QJsonValue &value);
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) Q_DECL_OVERRIDE;
+    bool moveRows(const QModelIndex &sourceParent, int sourceRow, int count,
+                  const QModelIndex &destinationParent, int destinationChild) Q_DECL_OVERRIDE;
+    bool replaceValue(const QModelIndex &index, const QJsonValue &value);
+    //! Lookups by RFC 6901 JSON Pointer or dotted path, about O(depth)
+    QModelIndex indexFromPointer(const QString &pointer);
+    QModelIndex indexFromPath(const QString &path);
+    QString pointer(const QModelIndex &index) const;
+    //! Full text search over keys and values, see QJsonFilterProxyModel
+    void setSearchEnabled(bool enabled);
+    bool isSearchEnabled() const;
+    bool isSearchIndexReady() const;
+    QModelIndexList search(const QString &text);
+    //! RFC 6902 JSON Patch, applied completely or not at all
+    bool applyJsonPatch(const QJsonArray &patch);
+    //! RFC 7386 JSON Merge Patch of the whole document
+    bool applyMergePatch(const QJsonValue &patch);
     int columnCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
     Qt::ItemFlags flags(const QModelIndex &index) const Q_DECL_OVERRIDE;
-    QByteArray json() ;
+    QByteArray json(bool compact = false) const;
+    void writeJson(QByteArray &buffer, bool compact = false) const;
+    bool writeJson(QIODevice *device, bool compact = false) const;
     QByteArray jsonToByte(QJsonValue jsonValue);
-    void objectToJson(QJsonObject jsonObject, QByteArray &json, int indent, bool compact);
-    void arrayToJson(QJsonArray jsonArray, QByteArray &json, int indent, bool compact);
-    void arrayContentToJson(QJsonArray jsonArray, QByteArray &json, int indent, bool compact);
-    void objectContentToJson(QJsonObject jsonObject, QByteArray &json, int indent, bool compact);
-    void valueToJson(QJsonValue jsonValue, QByteArray &json, int indent, bool compact);
+    void objectToJson(const QJsonObject &jsonObject, QByteArray &json, int indent, bool compact);
+    void arrayToJson(const QJsonArray &jsonArray, QByteArray &json, int indent, bool compact);
+    void arrayContentToJson(const QJsonArray &jsonArray, QByteArray &json, int indent, bool compact);
+    void objectContentToJson(const QJsonObject &jsonObject, QByteArray &json, int indent, bool compact);
+    void valueToJson(const QJsonValue &jsonValue, QByteArray &json, int indent, bool compact);
     //! List of tags to skip during JSON parsing
     void addException(const QStringList &exceptions);
+    //! Allocates the nodes of loaded documents from a per-model arena
+    void setArenaEnabled(bool enabled);
+    bool isArenaEnabled() const;
+    //! Children of loaded documents are created when a view expands their parent
+    void setLazyLoading(bool enabled);
+    bool isLazyLoading() const;
+    void setLoadThreads(int threads);
+    int loadThreads() const;
+    void setDateExport(DateExport mode);
+    DateExport dateExport() const;
 
     QByteArray serialize() const;
+    int serialize(char *data, int size) const;
+    int serializedSize() const;
     QMap<int, QByteArray> serializeToMap(bool RwOnly = false) const;
+    bool hasDirtyItems() const;
+    QMap<int, QByteArray> takeDirtyRanges();
     bool deserialize(const QByteArray &arr);
+    bool deserialize(const char *data, int size);
+
+signals:
+    void loadProgress(qint64 bytesRead, qint64 bytesTotal);
+    void loadFinished(bool success);
+    void searchIndexReady();
 
 private:
-    QJsonValue genJson(QJsonTreeItem *) const;
-    QMap<int, QByteArray> serialize(QJsonTreeItem *, bool RwOnly = false) const;
-    bool deserialize(QJsonTreeItem *item, const QByteArray &arr);
+    //! Tree built by a background load, owned by the model once delivered
+    struct LoadResult {
+        QJsonTreeItem *root = nullptr;
+        QJsonTreeItemArena *arena = nullptr;
+        QString error;
+    };
+    void finishAsyncLoad();
+    void discardLoadResult(const LoadResult &result);
+    struct SearchIndex;
+    void searchItems(QJsonTreeItem *item, const QString &needle, QModelIndexList &matches);
+    void buildSearchIndex();
+    void collectItems(QJsonTreeItem *item, QVector<QJsonTreeItem*> &items);
+    void finishSearchIndex();
+    void invalidateSearch();
+    void updateSearchEntry(QJsonTreeItem *item);
+    void addSearchEntries(QJsonTreeItem *item);
+    void removeSearchEntries(QJsonTreeItem *item);
+    static QString searchKey(QJsonTreeItem *item);
+
+    static int countItems(QJsonTreeItem *item);
+    //! Precompiled serialization step of one described leaf
+    struct PlanSlot {
+        int offset;  //!< Position in the serialized image
+        int address;
+        int size;
+        QJsonTreeItem *item;
+    };
+    const QVector<PlanSlot> &plan() const;
+    void collectLeaves(QJsonTreeItem *item, QVector<PlanSlot> &leaves) const;
+    void invalidatePlan();
+    bool deserialize(QJsonTreeItem *item, const char *data, int size);
+    QJsonTreeItemArena *treeArena() const;
+    QJsonTreeItem *itemFromIndex(const QModelIndex &index) const;
+    QJsonTreeItemArena *editArena() const;
+    QJsonTreeItem *createItem(const QString &key, const QJsonValue &value);
+    void deleteItem(QJsonTreeItem *item);
+    void forgetItems(QJsonTreeItem *item);
+    const QValidator *validator(QJsonTreeItem *item) const;
+    bool acceptsValue(QJsonTreeItem *item, const QVariant &value) const;
+    void applyValue(QJsonTreeItem *item, const QVariant &value);
+    void emitChangedRuns(QVector<QJsonTreeItem*> items, const QVector<int> &roles);
+    void flushChanges();
+    //! Objects with at least this many members get a key hash in mKeyIndex
+    enum { KeyIndexThreshold = 32 };
+    int childRow(QJsonTreeItem *item, const QString &token) const;
+    bool resolvePointer(const QString &pointer, QModelIndex &index);
+    bool resolveTokens(const QStringList &tokens, QModelIndex &index);
+    bool patchAdd(const QString &path, const QJsonValue &value);
+    bool patchRemove(const QString &path);
+    bool mergePatch(const QModelIndex &target, const QJsonValue &patch);
+    //! Inverse of one structural edit made by applyJsonPatch()
+    struct PatchStep {
+        enum Kind { Inserted, Removed, Replaced };
+        PatchStep(Kind kind = Inserted, QJsonTreeItem *item = nullptr, int row = 0)
+            : kind(kind), item(item), row(row) {}
+        Kind kind;
+        QJsonTreeItem *item;          //!< Parent of the rows, the replaced item itself for Replaced
+        int row;
+        QList<QJsonTreeItem*> items;  //!< Detached rows or old children, deleted once the patch succeeds
+        QVariant value;               //!< Old value of a replaced item
+        QJsonValue pending;           //!< Old source of a replaced pending container
+        QJsonValue::Type type = QJsonValue::Null;
+        bool isPending = false;
+        bool isDirty = false;
+    };
+    void rollbackPatch(const QVector<PatchStep> &journal);
+    void commitPatch(const QVector<PatchStep> &journal);
+    QModelIndex indexOfItem(QJsonTreeItem *item) const;
+    //! Frees the current tree, mRootItem must be reassigned afterwards
+    void releaseTree();
+    bool setRootItem(QJsonTreeItem *root, QJsonTreeItemArena *arena, const QString &error = QString());
 
 private:
     QJsonTreeItem * mRootItem;
     QStringList mHeaders;
     //! List of exceptions (e.g. comments). Case insensitive, compairs on "contains".
     QStringList mExceptions;
+    QJsonTreeItemArena * mArena = nullptr;
+    bool mArenaEnabled = false;
+    int mLoadThreads = 1;
+    bool mLazyLoading = false;
+    DateExport mDateExport = SchemaDates;
+    mutable QVector<PlanSlot> mPlan;
+    mutable int mPlanSize = 0;
+    mutable bool mPlanValid = false;
+    //! Described leaves edited through setData() since the last takeDirtyRanges()
+    QVector<QJsonTreeItem*> mDirtyItems;
+    //! Lazily built key lookup of large objects, kept in sync by the structural edits
+    mutable QHash<const QJsonTreeItem*, QHash<QString, QJsonTreeItem*>> mKeyIndex;
+    //! Background load started by loadAsync(), cancelled through mCancelLoad
+    QFutureWatcher<LoadResult> *mLoadWatcher = nullptr;
+    QAtomicInt mCancelLoad;
+    bool mLoadPending = false; //!< Set until finishAsyncLoad() takes the result
+    //! Items changed inside beginUpdate()/endUpdate(), not reported yet
+    QVector<QJsonTreeItem*> mChangedItems;
+    int mUpdateDepth = 0;
+    //! Edit validators by field type and size, owned by the model
+    mutable QHash<quint64, QValidator*> mValidators;
+    //! Search index of the current tree, null while outdated or being built
+    SearchIndex *mSearch = nullptr;
+    QFutureWatcher<SearchIndex*> *mSearchWatcher = nullptr;
+    int mSearchGeneration = 0; //!< Bumped by structural changes, older snapshots are discarded
+    bool mSearchPending = false; //!< Set until finishSearchIndex() takes the built index
+    bool mSearchEnabled = false;
+    //! Inverse steps of the running applyJsonPatch(), removed items are kept until it is done
+    QVector<PatchStep> *mPatchJournal = nullptr;
+
+    friend class QJsonTreeDiff;
+};
+
+/**
+ * @brief The QJsonTreeDiff class
+ * Differences between two item trees, e.g. the defaults of a description and
+ * a deserialized device image. Object members are matched by key through a
+ * hash, array elements by position.
+ */
+class QJsonTreeDiff
+{
+public:
+    enum Operation {
+        Added, Removed, Changed
+    };
+    struct Entry {
+        Operation op = Changed;
+        QString path;      //!< RFC 6901 pointer, into the old tree for removals
+        QJsonValue value;  //!< New value, null for removals
+        int address = 0;   //!< Register range of described leaves, size is 0 otherwise
+        int size = 0;
+    };
+
+    static QJsonTreeDiff compare(const QJsonTreeItem *from, const QJsonTreeItem *to, const QStringList &exceptions = {});
+    static QJsonTreeDiff compare(const QJsonModel &from, const QJsonModel &to);
+
+    const QVector<Entry> &entries() const;
+    bool isEmpty() const;
+    //!< Merged address ranges (address, size) of all described leaves that differ
+    QMap<int, int> changedRanges() const;
+    //!< The differences as RFC 6902 operations turning from into to
+    QJsonArray toJsonPatch() const;
+
+private:
+    void compareItems(const QJsonTreeItem *from, const QJsonTreeItem *to, const QString &path);
+    void addEntry(Operation op, const QString &path, const QJsonTreeItem *item);
+    void collectRanges(const QJsonTreeItem *item);
+
+    QVector<Entry> mEntries;
+    QVector<QPair<int, int>> mRanges;
+    QStringList mExceptions;
+};
+
+/**
+ * @brief The QJsonFilterProxyModel class
+ * Shows the items of a QJsonModel matching a search text together with their
+ * ancestors, using the search index of the model when it is ready.
+ */
+class QJsonFilterProxyModel : public QSortFilterProxyModel
+{
+    Q_OBJECT
+public:
+    explicit QJsonFilterProxyModel(QObject *parent = nullptr);
+    void setSourceModel(QAbstractItemModel *sourceModel) Q_DECL_OVERRIDE;
+    void setSearchText(const QString &text);
+    QString searchText() const;
+    void refresh();
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const Q_DECL_OVERRIDE;
+
+private:
+    void sourceChanged();
+
+    QString mSearchText;
+    QSet<const void*> mAccepted; //!< Source items of the matches and their ancestors
+    QList<QMetaObject::Connection> mSourceConnections;
 };
 
 #endif // QJSONMODEL_H
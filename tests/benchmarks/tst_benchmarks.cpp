@@ -0,0 +1,405 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+#include "qjsonmodel.h"
+
+/**
+ * @brief The tst_Benchmarks class
+ * Benchmarks of the model on generated documents, run with
+ * ./tst_benchmarks [function] to measure a single case.
+ */
+class tst_Benchmarks : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void parentLookup();
+    void nodeFootprint_data();
+    void nodeFootprint();
+    void loadAndRelease_data();
+    void loadAndRelease();
+    void loadDescription_data();
+    void loadDescription();
+    void writeJson_data();
+    void writeJson();
+    void parallelLoad_data();
+    void parallelLoad();
+    void paintLoop();
+    void valueStream_data();
+    void valueStream();
+    void snapshotLoad_data();
+    void snapshotLoad();
+};
+
+//!< Top-level array of records with four members each, five nodes per record
+static QByteArray recordsJson(int records)
+{
+    QByteArray json;
+    json.reserve(records * 64);
+    json += '[';
+    for (int i = 0; i < records; ++i) {
+        if (i > 0)
+            json += ',';
+        json += "{\"id\":" + QByteArray::number(i)
+                + ",\"name\":\"record " + QByteArray::number(i)
+                + "\",\"value\":" + QByteArray::number(i * 0.5)
+                + ",\"enabled\":" + (i % 2 ? "true" : "false") + '}';
+    }
+    json += ']';
+
+    return json;
+}
+
+//!< Flat register map and its description, every register is an uint field
+static void registersJson(int registers, QByteArray &json, QByteArray &description)
+{
+    json = "{";
+    description = "{";
+    for (int i = 0; i < registers; ++i) {
+        const QByteArray key = "\"reg" + QByteArray::number(i) + "\":";
+        if (i > 0) {
+            json += ',';
+            description += ',';
+        }
+        json += key + QByteArray::number(i);
+        description += key + "{\"mode2\":\"rw\",\"type\":\"uint\",\"addr\":\""
+                + QByteArray::number(i * 4, 16) + "\",\"size\":4,\"desc\":\"register "
+                + QByteArray::number(i) + "\",\"default\":\"0\"}";
+    }
+    json += '}';
+    description += '}';
+}
+
+//!< Resident set size of the process in bytes, 0 where /proc is not available
+static qint64 residentBytes()
+{
+#ifdef Q_OS_LINUX
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly))
+        return 0;
+
+    // size resident shared ... in pages
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.size() < 2)
+        return 0;
+
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+//!< Object with one member per key
+static QByteArray wideJson(int keys)
+{
+    QByteArray json = "{";
+    for (int i = 0; i < keys; ++i) {
+        if (i > 0)
+            json += ',';
+        json += "\"key" + QByteArray::number(i) + "\":\"value " + QByteArray::number(i) + '"';
+    }
+    json += '}';
+
+    return json;
+}
+
+//!< Array of chains of nested objects, QJsonDocument parses up to 1024 levels
+static QByteArray deepJson(int chains, int depth)
+{
+    QByteArray chain;
+    for (int i = 0; i < depth; ++i)
+        chain += "{\"name\":\"level " + QByteArray::number(i) + "\",\"next\":";
+    chain += "null";
+    chain += QByteArray(depth, '}');
+
+    QByteArray json = "[";
+    for (int i = 0; i < chains; ++i) {
+        if (i > 0)
+            json += ',';
+        json += chain;
+    }
+    json += ']';
+
+    return json;
+}
+
+//!< Walks every index of a 1M node document through parent()
+void tst_Benchmarks::parentLookup()
+{
+    QJsonModel model;
+    QVERIFY(model.loadJson(recordsJson(200000)));
+    const int records = model.rowCount();
+    QCOMPARE(records, 200000);
+
+    QBENCHMARK {
+        for (int i = 0; i < records; ++i) {
+            const QModelIndex record = model.index(i, 0);
+            if (model.parent(record).isValid())
+                QFAIL("records must be top level");
+            const int members = model.rowCount(record);
+            for (int j = 0; j < members; ++j) {
+                if (model.parent(model.index(j, 0, record)) != record)
+                    QFAIL("parent() does not match");
+            }
+        }
+    }
+}
+
+void tst_Benchmarks::nodeFootprint_data()
+{
+    QTest::addColumn<bool>("described");
+    QTest::addColumn<bool>("arena");
+    QTest::newRow("plain/heap") << false << false;
+    QTest::newRow("plain/arena") << false << true;
+    QTest::newRow("described/heap") << true << false;
+    QTest::newRow("described/arena") << true << true;
+}
+
+/**
+ * Memory per node of a loaded register map, reported as bytes allocated.
+ * Measured as growth of the resident set over the load, so it includes the
+ * keys, values, child lists and allocator overhead, not only sizeof(QJsonTreeItem).
+ * Freed memory of earlier rows may be reused, run a single row for exact numbers.
+ */
+void tst_Benchmarks::nodeFootprint()
+{
+    QFETCH(bool, described);
+    QFETCH(bool, arena);
+    if (residentBytes() == 0)
+        QSKIP("resident set size is read from /proc/self/statm");
+
+    const int registers = 200000;
+    QByteArray json, description;
+    registersJson(registers, json, description);
+    if (!described)
+        description.clear();
+
+    QJsonModel model;
+    model.setArenaEnabled(arena);
+    const qint64 before = residentBytes();
+    QVERIFY(described ? model.loadJson(json, description) : model.loadJson(json));
+    const qint64 after = residentBytes();
+    QCOMPARE(model.rowCount(), registers);
+
+    // the root and one leaf per register
+    const qreal bytesPerNode = qreal(after - before) / (registers + 1);
+    qDebug("%s: %.1f bytes per node", QTest::currentDataTag(), bytesPerNode);
+    QTest::setBenchmarkResult(bytesPerNode, QTest::BytesAllocated);
+}
+
+void tst_Benchmarks::loadAndRelease_data()
+{
+    QTest::addColumn<bool>("arena");
+    QTest::newRow("heap") << false;
+    QTest::newRow("arena") << true;
+}
+
+//!< Every load releases the previous document, so both costs are measured
+void tst_Benchmarks::loadAndRelease()
+{
+    QFETCH(bool, arena);
+    const QByteArray json = recordsJson(200000);
+    QJsonModel model;
+    model.setArenaEnabled(arena);
+
+    QBENCHMARK {
+        QVERIFY(model.loadJson(json));
+    }
+}
+
+void tst_Benchmarks::loadDescription_data()
+{
+    QTest::addColumn<int>("mode");
+    QTest::newRow("plain") << 0;
+    QTest::newRow("loadWithDesc") << 1;
+    QTest::newRow("loadByDesc") << 2;
+}
+
+//!< 40k registers, plain load() is the baseline the described loads are compared to
+void tst_Benchmarks::loadDescription()
+{
+    QFETCH(int, mode);
+    QByteArray json, description;
+    registersJson(40000, json, description);
+    QJsonModel model;
+
+    QBENCHMARK {
+        if (mode == 0)
+            QVERIFY(model.loadJson(json));
+        else if (mode == 1)
+            QVERIFY(model.loadJson(json, description));
+        else
+            QVERIFY(model.loadJsonByDescription(description));
+    }
+    QCOMPARE(model.rowCount(), 40000);
+}
+
+void tst_Benchmarks::writeJson_data()
+{
+    QTest::addColumn<QByteArray>("json");
+    QTest::addColumn<bool>("model");
+    const QByteArray wide = wideJson(100000);
+    const QByteArray deep = deepJson(200, 500);
+    QTest::newRow("wide/QJsonModel") << wide << true;
+    QTest::newRow("wide/QJsonDocument") << wide << false;
+    QTest::newRow("deep/QJsonModel") << deep << true;
+    QTest::newRow("deep/QJsonDocument") << deep << false;
+}
+
+//!< The model's writer against QJsonDocument::toJson() on the same document
+void tst_Benchmarks::writeJson()
+{
+    QFETCH(QByteArray, json);
+    QFETCH(bool, model);
+
+    if (model) {
+        QJsonModel jsonModel;
+        QVERIFY(jsonModel.loadJson(json));
+        QByteArray output;
+        QBENCHMARK {
+            output.resize(0);
+            jsonModel.writeJson(output);
+        }
+        QVERIFY(!output.isEmpty());
+    } else {
+        const QJsonDocument document = QJsonDocument::fromJson(json);
+        QVERIFY(!document.isNull());
+        QByteArray output;
+        QBENCHMARK {
+            output = document.toJson();
+        }
+        QVERIFY(!output.isEmpty());
+    }
+}
+
+void tst_Benchmarks::parallelLoad_data()
+{
+    QTest::addColumn<int>("threads");
+    for (int threads : { 1, 2, 4, 8 })
+        QTest::newRow(qPrintable(QString("%1 threads").arg(threads))) << threads;
+}
+
+//!< Scaling of the parallel build with the thread count, the tree must match the serial one
+void tst_Benchmarks::parallelLoad()
+{
+    QFETCH(int, threads);
+    const QByteArray json = recordsJson(200000);
+    QJsonModel serial;
+    QVERIFY(serial.loadJson(json));
+
+    QJsonModel model;
+    model.setLoadThreads(threads);
+    QBENCHMARK {
+        QVERIFY(model.loadJson(json));
+    }
+    QCOMPARE(model.json(true), serial.json(true));
+}
+
+//!< What a view asks per repaint of 100k visible rows, both columns
+void tst_Benchmarks::paintLoop()
+{
+    QJsonModel model;
+    QVERIFY(model.loadJson(wideJson(100000)));
+    const int rows = model.rowCount();
+    QCOMPARE(rows, 100000);
+
+    QVector<QModelIndex> keys, values;
+    keys.reserve(rows);
+    values.reserve(rows);
+    for (int i = 0; i < rows; ++i) {
+        keys.append(model.index(i, 0));
+        values.append(model.index(i, 1));
+    }
+
+    QBENCHMARK {
+        for (int i = 0; i < rows; ++i) {
+            model.data(keys.at(i), Qt::DisplayRole);
+            model.data(values.at(i), Qt::DisplayRole);
+            model.data(values.at(i), Qt::ToolTipRole);
+        }
+    }
+}
+
+void tst_Benchmarks::valueStream_data()
+{
+    QTest::addColumn<bool>("transaction");
+    QTest::newRow("setData") << false;
+    QTest::newRow("beginUpdate") << true;
+}
+
+/**
+ * One frame of a 10 kHz stream to 5000 leaves: every leaf gets a new value and
+ * a view repaints the rows reported by dataChanged. The rows repainted per
+ * frame and the number of signals are checked after the measurement.
+ */
+void tst_Benchmarks::valueStream()
+{
+    QFETCH(bool, transaction);
+    const int leaves = 5000;
+    QJsonModel model;
+    QVERIFY(model.loadJson(wideJson(leaves)));
+
+    int signalCount = 0;
+    int repainted = 0;
+    connect(&model, &QJsonModel::dataChanged, [&](const QModelIndex &topLeft, const QModelIndex &bottomRight) {
+        ++signalCount;
+        for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+            model.data(model.index(row, 1, topLeft.parent()), Qt::DisplayRole);
+            ++repainted;
+        }
+    });
+
+    int frame = 0;
+    QBENCHMARK {
+        signalCount = 0;
+        repainted = 0;
+        ++frame;
+        if (transaction)
+            model.beginUpdate();
+        for (int i = 0; i < leaves; ++i)
+            model.setData(model.index(i, 1), QString("sample %1").arg(frame));
+        if (transaction)
+            model.endUpdate();
+    }
+
+    QCOMPARE(repainted, leaves);
+    QCOMPARE(signalCount, transaction ? 1 : leaves);
+}
+
+void tst_Benchmarks::snapshotLoad_data()
+{
+    QTest::addColumn<bool>("snapshot");
+    QTest::newRow("loadJson") << false;
+    QTest::newRow("loadSnapshot") << true;
+}
+
+//!< Reload of a described document, parsed again or mapped from a snapshot
+void tst_Benchmarks::snapshotLoad()
+{
+    QFETCH(bool, snapshot);
+    QByteArray json, description;
+    registersJson(200000, json, description);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.filePath("registers.snapshot");
+
+    QJsonModel source;
+    QVERIFY(source.loadJson(json, description));
+    QVERIFY(source.saveSnapshot(fileName));
+
+    QJsonModel model;
+    QBENCHMARK {
+        if (snapshot)
+            QVERIFY(model.loadSnapshot(fileName));
+        else
+            QVERIFY(model.loadJson(json, description));
+    }
+    QCOMPARE(model.json(true), source.json(true));
+    QCOMPARE(model.serialize(), source.serialize());
+}
+
+QTEST_GUILESS_MAIN(tst_Benchmarks)
+
+#include "tst_benchmarks.moc"
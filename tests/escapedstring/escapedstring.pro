@@ -0,0 +1,15 @@
+QT       += core gui widgets concurrent testlib
+CONFIG   += c++11 testcase
+lessThan(QT_MAJOR_VERSION, 5): error("requires Qt 5")
+
+TARGET = tst_escapedstring
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_escapedstring.cpp \
+    ../../qjsonmodel.cpp
+
+HEADERS += \
+    ../../qjsonmodel.h
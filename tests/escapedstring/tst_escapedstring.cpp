@@ -0,0 +1,186 @@
+#include <QtTest>
+#include <random>
+#include "qjsonmodel.h"
+
+/**
+ * @brief The tst_EscapedString class
+ * Checks that escapedString() writes exactly the bytes of the original per-unit
+ * implementation, kept below as the reference. SSE2 blocks are 8 UTF-16 units
+ * (16 bytes), so the cases put units that need escaping at every offset around
+ * block boundaries.
+ */
+class tst_EscapedString : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void specialAtEveryOffset();
+    void twoSpecialsInOneBlock();
+    void randomStrings();
+};
+
+//!< Units that leave the fast path: controls, quote, backslash, non-ASCII and lone surrogates
+static const ushort specials[] = {
+    0x00, 0x01, 0x08, 0x09, 0x0a, 0x0c, 0x0d, 0x1f, 0x22, 0x5c,
+    0x7f, 0x80, 0xe9, 0xff, 0x100, 0x20ac, 0xd800, 0xdbff, 0xdc00, 0xdfff, 0xfffd
+};
+
+static inline uchar hexdig(uint u)
+{
+    return (u < 0xa ? '0' + u : 'a' + u - 0xa);
+}
+
+/**
+ * escapedString() as it was before the SSE2 block copy, copied unchanged except
+ * for the growth check: it resized once per unit, which is not enough room for
+ * a six byte escape in strings shorter than four units, so it loops now.
+ */
+static QByteArray referenceEscapedString(const QString &s)
+{
+    QByteArray ba(s.length(), Qt::Uninitialized);
+    uchar *cursor = reinterpret_cast<uchar *>(const_cast<char *>(ba.constData()));
+    const uchar *ba_end = cursor + ba.length();
+    const ushort *src = reinterpret_cast<const ushort *>(s.constBegin());
+    const ushort *const end = reinterpret_cast<const ushort *>(s.constEnd());
+    while (src != end) {
+        while (cursor >= ba_end - 6) {
+            // ensure we have enough space
+            int pos = cursor - (const uchar *)ba.constData();
+            ba.resize(ba.size() * 2);
+            cursor = (uchar *)ba.data() + pos;
+            ba_end = (const uchar *)ba.constData() + ba.length();
+        }
+        uint u = *src++;
+        if (u < 0x80) {
+            if (u < 0x20 || u == 0x22 || u == 0x5c) {
+                *cursor++ = '\\';
+                switch (u) {
+                case 0x22:
+                    *cursor++ = '"';
+                    break;
+                case 0x5c:
+                    *cursor++ = '\\';
+                    break;
+                case 0x8:
+                    *cursor++ = 'b';
+                    break;
+                case 0xc:
+                    *cursor++ = 'f';
+                    break;
+                case 0xa:
+                    *cursor++ = 'n';
+                    break;
+                case 0xd:
+                    *cursor++ = 'r';
+                    break;
+                case 0x9:
+                    *cursor++ = 't';
+                    break;
+                default:
+                    *cursor++ = 'u';
+                    *cursor++ = '0';
+                    *cursor++ = '0';
+                    *cursor++ = hexdig(u >> 4);
+                    *cursor++ = hexdig(u & 0xf);
+                }
+            } else {
+                *cursor++ = (uchar)u;
+            }
+        } else if (QUtf8Functions::toUtf8<QUtf8BaseTraits>(u, cursor, src, end) < 0) {
+            // failed to get valid utf8 use JSON escape sequence
+            *cursor++ = '\\';
+            *cursor++ = 'u';
+            *cursor++ = hexdig(u >> 12 & 0x0f);
+            *cursor++ = hexdig(u >> 8 & 0x0f);
+            *cursor++ = hexdig(u >> 4 & 0x0f);
+            *cursor++ = hexdig(u & 0x0f);
+        }
+    }
+    ba.resize(cursor - (const uchar *)ba.constData());
+    return ba;
+}
+
+static QString describe(const QString &s)
+{
+    QStringList units;
+    for (const QChar c : s)
+        units.append(QString::number(c.unicode(), 16));
+
+    return "input units: " + units.join(' ');
+}
+
+//!< Fails the current test with the input if escapedString() differs from the reference
+#define VERIFY_SAME_ESCAPING(s) \
+    do { \
+        const QString input_ = (s); \
+        if (escapedString(input_) != referenceEscapedString(input_)) \
+            QFAIL(qPrintable(describe(input_))); \
+    } while (0)
+
+void tst_EscapedString::specialAtEveryOffset()
+{
+    for (int length = 0; length <= 33; ++length) {
+        VERIFY_SAME_ESCAPING(QString(length, 'a'));
+        for (ushort special : specials) {
+            for (int offset = 0; offset < length; ++offset) {
+                QString s(length, 'a');
+                s[offset] = QChar(special);
+                VERIFY_SAME_ESCAPING(s);
+            }
+            VERIFY_SAME_ESCAPING(QString(length, QChar(special)));
+        }
+    }
+}
+
+void tst_EscapedString::twoSpecialsInOneBlock()
+{
+    // a surrogate pair split or joined by the block boundary is covered as well
+    const ushort pairs[][2] = { { 0x22, 0x0a }, { 0x5c, 0xe9 }, { 0xd83d, 0xde00 }, { 0xdc00, 0xd800 } };
+    for (int length = 16; length <= 33; ++length) {
+        for (const auto &pair : pairs) {
+            for (int first = 0; first < 16; ++first) {
+                for (int second = first + 1; second < length; ++second) {
+                    QString s(length, 'x');
+                    s[first] = QChar(pair[0]);
+                    s[second] = QChar(pair[1]);
+                    VERIFY_SAME_ESCAPING(s);
+                }
+            }
+        }
+    }
+}
+
+void tst_EscapedString::randomStrings()
+{
+    std::mt19937 random(20261017);
+    std::uniform_int_distribution<int> lengths(0, 80);
+    std::uniform_int_distribution<int> kinds(0, 99);
+    std::uniform_int_distribution<int> printable(0x20, 0x7e);
+    std::uniform_int_distribution<int> units(0, 0xffff);
+    std::uniform_int_distribution<int> specialIndex(0, int(sizeof(specials) / sizeof(specials[0])) - 1);
+
+    for (int n = 0; n < 200000; ++n) {
+        QString s;
+        const int length = lengths(random);
+        s.reserve(length + 1);
+        while (s.size() < length) {
+            const int kind = kinds(random);
+            if (kind < 75) {
+                // mostly long ASCII runs, like real exports
+                s.append(QChar(ushort(printable(random))));
+            } else if (kind < 90) {
+                s.append(QChar(specials[specialIndex(random)]));
+            } else if (kind < 95) {
+                s.append(QChar(ushort(0xd800 + units(random) % 0x400)));
+                s.append(QChar(ushort(0xdc00 + units(random) % 0x400)));
+            } else {
+                s.append(QChar(ushort(units(random))));
+            }
+        }
+        VERIFY_SAME_ESCAPING(s);
+    }
+}
+
+QTEST_GUILESS_MAIN(tst_EscapedString)
+
+#include "tst_escapedstring.moc"